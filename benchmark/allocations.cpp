@@ -0,0 +1,85 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <numeric>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "implementation/concurrent_tree.hpp"
+
+//counts the allocations of the whole process, so the benchmarks only use a single thread
+static std::atomic<std::uint64_t> allocations = 0;
+
+void* operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  const std::size_t align = static_cast<std::size_t>(alignment);
+  if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+enum class Workload {
+  kLookup,
+  kInsertRemove,
+  kRangeCount,
+};
+
+//allocations per operation on a tree that already served operations of the same kind, reported as the allocs_per_op counter
+template <int num_keys = 100'000, Workload workload = Workload::kLookup, std::size_t MaxThreads = 0>
+void BM_allocations(benchmark::State& state) {
+  std::vector<int> keys(num_keys);
+  //every other value, so inserts of the odd ones succeed
+  std::iota(keys.begin(), keys.end(), 0);
+  for (int& k : keys) {
+    k = 2 * k + 2;
+  }
+  ConcurrentTree<int, true, DefaultRebuildPolicy, MaxThreads> tree(std::span<const int>(keys), 1);
+  std::default_random_engine rng(42);
+  std::uniform_int_distribution<> dist(1, 2 * num_keys);
+
+  auto run = [&] {
+    const int k = dist(rng);
+    if constexpr (workload == Workload::kLookup) {
+      benchmark::DoNotOptimize(tree.lookup(k, 0));
+    } else if constexpr (workload == Workload::kInsertRemove) {
+      if (tree.insert(k, 0))
+        tree.remove(k, 0);
+    } else {
+      benchmark::DoNotOptimize(tree.range_count(k, k + 100, 0));
+    }
+  };
+  //warm up the scratch buffers and retired lists
+  for (int i = 0; i < 10'000; ++i) {
+    run();
+  }
+
+  const std::uint64_t before = allocations.load(std::memory_order_relaxed);
+  for (auto _ : state) {
+    run();
+  }
+  const std::uint64_t count = allocations.load(std::memory_order_relaxed) - before;
+  state.counters["allocs_per_op"] = static_cast<double>(count) / static_cast<double>(state.iterations());
+}
+
+BENCHMARK(BM_allocations<100'000, Workload::kLookup>);
+BENCHMARK(BM_allocations<100'000, Workload::kInsertRemove>);
+BENCHMARK(BM_allocations<100'000, Workload::kRangeCount>);
+//the queues of new nodes do not allocate their per-thread arrays
+BENCHMARK(BM_allocations<100'000, Workload::kLookup, 1>);
+BENCHMARK(BM_allocations<100'000, Workload::kInsertRemove, 1>);
+BENCHMARK(BM_allocations<100'000, Workload::kRangeCount, 1>);
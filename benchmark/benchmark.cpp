@@ -7,11 +7,19 @@
 #include <vector>
 #include <random>
 #include <thread>
+#include <string>
+#include <functional>
+#include <cmath>
+#include <numeric>
+#include <limits>
+#include <memory>
 
 #include "implementation/concurrent_tree.hpp"
+#include "implementation/sharded_tree.hpp"
+#include "implementation/string_key.hpp"
 
 //alpha is in percent
-template <int min = 1, int max = 1'000'000, int alpha = 50, int range_size = 100, int ops_per_thread = 20'000, bool rebuild = true>
+template <int min = 1, int max = 1'000'000, int alpha = 50, int range_size = 100, int ops_per_thread = 20'000, bool rebuild = true, class Policy = DefaultRebuildPolicy, std::size_t MaxThreads = 0>
 void BM_tree(benchmark::State& state) {
   const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
   std::default_random_engine rng(num_threads);
@@ -29,7 +37,7 @@ void BM_tree(benchmark::State& state) {
     state.PauseTiming();
     std::vector<std::jthread> threads;
     threads.reserve(num_threads);
-    ConcurrentTree<int> tree(prefill, num_threads);
+    ConcurrentTree<int, true, Policy, MaxThreads> tree(prefill, num_threads);
     state.ResumeTiming();
     {
       for(unsigned int i = 0; i < num_threads; ++i) {
@@ -67,7 +75,7 @@ void BM_tree(benchmark::State& state) {
   }
 }
 
-template <int min = 1, int max = 1'000'000, int alpha = 50, int ops_per_thread = 20'000, bool rebuild = true>
+template <int min = 1, int max = 1'000'000, int alpha = 50, int ops_per_thread = 20'000, bool rebuild = true, class Policy = DefaultRebuildPolicy>
 void BM_insertremove(benchmark::State& state) {
   const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
   std::default_random_engine rng(num_threads);
@@ -85,7 +93,7 @@ void BM_insertremove(benchmark::State& state) {
     state.PauseTiming();
     std::vector<std::jthread> threads;
     threads.reserve(num_threads);
-    ConcurrentTree<int> tree(prefill, num_threads);
+    ConcurrentTree<int, true, Policy> tree(prefill, num_threads);
     state.ResumeTiming();
     {
       for(unsigned int i = 0; i < num_threads; ++i) {
@@ -205,7 +213,7 @@ void BM_norange(benchmark::State& state) {
   }
 }
 
-template <int min = 1, int max = 1'000'000, int alpha = 50, int ops_per_thread = 20'000, bool rebuild = true>
+template <int min = 1, int max = 1'000'000, int alpha = 50, int ops_per_thread = 20'000, bool rebuild = true, std::size_t leaf_block_size = 0>
 void BM_lookup(benchmark::State& state) {
   const unsigned int num_threads = state.range(0);
   std::default_random_engine rng(num_threads);
@@ -221,7 +229,7 @@ void BM_lookup(benchmark::State& state) {
     state.PauseTiming();
     std::vector<std::jthread> threads;
     threads.reserve(num_threads);
-    ConcurrentTree<int> tree(prefill, num_threads);
+    ConcurrentTree<int> tree(prefill, num_threads, TreeOptions{.leaf_block_size = leaf_block_size});
     state.ResumeTiming();
 
     for(unsigned int i = 0; i < num_threads; ++i) {
@@ -239,9 +247,430 @@ void BM_lookup(benchmark::State& state) {
   }
 }
 
+std::vector<std::string> make_url_paths(std::size_t num, unsigned int seed) {
+  const std::vector<std::string> segments = {"api", "v1", "v2", "users", "items", "orders", "static", "img", "search", "docs"};
+  std::default_random_engine rng(seed);
+  std::uniform_int_distribution<std::size_t> seg_dist(0, segments.size() - 1);
+  std::uniform_int_distribution<int> len_dist(1, 4);
+  std::uniform_int_distribution<int> id_dist(1, 1'000'000);
+  std::vector<std::string> paths(num);
+  for (auto& p : paths) {
+    int len = len_dist(rng);
+    for (int j = 0; j < len; ++j) {
+      p += "/" + segments[seg_dist(rng)];
+    }
+    p += "/" + std::to_string(id_dist(rng));
+  }
+  return paths;
+}
+
+//same mix as BM_tree on a tree split into num_shards key ranges
+template <int min = 1, int max = 1'000'000, int alpha = 50, int range_size = 100, int ops_per_thread = 20'000, int num_shards = 16>
+void BM_sharded(benchmark::State& state) {
+  const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
+  std::default_random_engine rng(num_threads);
+  std::uniform_int_distribution<> dist(min, max);
+  std::uniform_int_distribution<> opdist(1, 4);
+
+  std::vector<int> data(ops_per_thread * num_threads);
+  std::vector<int> ops(ops_per_thread * num_threads);
+  std::vector<int> prefill((max-min * alpha) / 100);
+  std::generate(data.begin(), data.end(), [&] { return dist(rng); });
+  std::generate(ops.begin(), ops.end(), [&] { return opdist(rng); });
+  std::generate(prefill.begin(), prefill.end(), [&] { return dist(rng); });
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    ShardedConcurrentTree<int> tree(prefill, num_shards, num_threads);
+    state.ResumeTiming();
+
+    for(unsigned int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < ops_per_thread; ++j) {
+          int op = ops[i * ops_per_thread + j];
+          int value = data[i * ops_per_thread + j];
+          switch (op)
+          {
+          case 1:
+            tree.insert(value, i);
+            break;
+          case 2:
+            tree.remove(value, i);
+            break;
+          case 3:
+            benchmark::DoNotOptimize(tree.lookup(value, i));
+            break;
+          case 4:
+            benchmark::DoNotOptimize(tree.range_count(value, value+range_size, i));
+            break;
+          default:
+            break;
+          }
+        }
+      });
+    }
+
+    for (auto &th: threads){
+      th.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * ops_per_thread * num_threads);
+}
+
+/**
+ * Draws values in [1, n] where value i has a probability proportional to 1/i^theta
+ */
+class ZipfDistribution {
+public:
+  ZipfDistribution(int n, double theta) : cdf_(n) {
+    double sum = 0;
+    for (int i = 0; i < n; ++i) {
+      sum += 1.0 / std::pow(i + 1, theta);
+      cdf_[i] = sum;
+    }
+    for (auto& c : cdf_) {
+      c /= sum;
+    }
+  }
+
+  template <class Rng>
+  int operator()(Rng& rng) {
+    double u = std::uniform_real_distribution<>(0.0, 1.0)(rng);
+    return static_cast<int>(std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin()) + 1;
+  }
+
+private:
+  std::vector<double> cdf_;
+};
+
+//hot keys: 80% lookups, 10% inserts and 10% removes of zipf distributed values (theta in percent), with and without elimination at the root
+template <int num_keys = 1'000'000, int theta = 99, int ops_per_thread = 50'000, bool root_elimination = true>
+void BM_zipf(benchmark::State& state) {
+  const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
+  std::default_random_engine rng(num_threads);
+  ZipfDistribution dist(num_keys, theta / 100.0);
+  std::uniform_int_distribution<> opdist(1, 10);
+
+  std::vector<int> data(ops_per_thread * num_threads);
+  std::vector<int> ops(ops_per_thread * num_threads);
+  std::generate(data.begin(), data.end(), [&] { return dist(rng); });
+  std::generate(ops.begin(), ops.end(), [&] { return opdist(rng); });
+  std::vector<int> prefill(num_keys / 2);
+  std::iota(prefill.begin(), prefill.end(), 1);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    ConcurrentTree<int> tree(std::span<const int>(prefill), num_threads, TreeOptions{.root_elimination = root_elimination});
+    state.ResumeTiming();
+
+    for(unsigned int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < ops_per_thread; ++j) {
+          int op = ops[i * ops_per_thread + j];
+          int value = data[i * ops_per_thread + j];
+          if (op == 1)
+            tree.insert(value, i);
+          else if (op == 2)
+            tree.remove(value, i);
+          else
+            benchmark::DoNotOptimize(tree.lookup(value, i));
+        }
+      });
+    }
+
+    for (auto &th: threads){
+      th.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * ops_per_thread * num_threads);
+}
+
+//few threads: 80% lookups, 10% range counts, 5% inserts and 5% removes, with and without reading the tree directly while it is uncontended
+template <int num_keys = 1'000'000, int ops_per_thread = 200'000, bool uncontended_reads = true>
+void BM_uncontended(benchmark::State& state) {
+  const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
+  std::default_random_engine rng(num_threads);
+  std::uniform_int_distribution<> dist(1, 2 * num_keys);
+  std::uniform_int_distribution<> opdist(1, 20);
+
+  std::vector<int> data(ops_per_thread * num_threads);
+  std::vector<int> ops(ops_per_thread * num_threads);
+  std::generate(data.begin(), data.end(), [&] { return dist(rng); });
+  std::generate(ops.begin(), ops.end(), [&] { return opdist(rng); });
+  std::vector<int> prefill(num_keys);
+  std::iota(prefill.begin(), prefill.end(), 1);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    ConcurrentTree<int> tree(std::span<const int>(prefill), num_threads, TreeOptions{.uncontended_reads = uncontended_reads});
+    state.ResumeTiming();
+
+    for(unsigned int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < ops_per_thread; ++j) {
+          int op = ops[i * ops_per_thread + j];
+          int value = data[i * ops_per_thread + j];
+          if (op == 1)
+            tree.insert(value, i);
+          else if (op == 2)
+            tree.remove(value, i);
+          else if (op <= 4)
+            benchmark::DoNotOptimize(tree.range_count(value, value + 100, i));
+          else
+            benchmark::DoNotOptimize(tree.lookup(value, i));
+        }
+      });
+    }
+
+    for (auto &th: threads){
+      th.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * ops_per_thread * num_threads);
+}
+
+//25% inserts, 25% removes and 50% lookups with the timestamps from the shared counter or the TSC,
+//uncontended reads are off for both, as they only work with the counter
+template <int num_keys = 1'000'000, int ops_per_thread = 20'000, TimestampSource source = TimestampSource::kCounter>
+void BM_timestamps(benchmark::State& state) {
+  const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
+  std::default_random_engine rng(num_threads);
+  std::uniform_int_distribution<> dist(1, 2 * num_keys);
+  std::uniform_int_distribution<> opdist(1, 4);
+
+  std::vector<int> data(ops_per_thread * num_threads);
+  std::vector<int> ops(ops_per_thread * num_threads);
+  std::generate(data.begin(), data.end(), [&] { return dist(rng); });
+  std::generate(ops.begin(), ops.end(), [&] { return opdist(rng); });
+  std::vector<int> prefill(num_keys);
+  std::iota(prefill.begin(), prefill.end(), 1);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    ConcurrentTree<int> tree(std::span<const int>(prefill), num_threads, TreeOptions{.uncontended_reads = false, .timestamp_source = source});
+    state.ResumeTiming();
+
+    for(unsigned int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < ops_per_thread; ++j) {
+          int op = ops[i * ops_per_thread + j];
+          int value = data[i * ops_per_thread + j];
+          if (op == 1)
+            tree.insert(value, i);
+          else if (op == 2)
+            tree.remove(value, i);
+          else
+            benchmark::DoNotOptimize(tree.lookup(value, i));
+        }
+      });
+    }
+
+    for (auto &th: threads){
+      th.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * ops_per_thread * num_threads);
+}
+
+//looks up random values in a tree of the odd values up to 2*num_keys, built once with the given layout
+template <int num_keys = 1'000'000, int ops_per_thread = 50'000, bool veb_layout = false, std::size_t leaf_block_size = 0>
+void BM_layout_lookup(benchmark::State& state) {
+  const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
+  std::default_random_engine rng(num_threads);
+  std::uniform_int_distribution<> dist(1, 2 * num_keys);
+
+  std::vector<int> keys(num_keys);
+  for (int i = 0; i < num_keys; ++i) {
+    keys[i] = 2 * i + 1;
+  }
+  std::vector<int> data(ops_per_thread * num_threads);
+  std::generate(data.begin(), data.end(), [&] { return dist(rng); });
+  //lookups do not change the tree, so it is only built once
+  ConcurrentTree<int> tree(std::span<const int>(keys), num_threads, TreeOptions{.leaf_block_size = leaf_block_size, .veb_layout = veb_layout});
+
+  for (auto _ : state) {
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for(unsigned int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < ops_per_thread; ++j) {
+          bool b = tree.lookup(data[i * ops_per_thread + j], i);
+          benchmark::DoNotOptimize(b);
+        }
+      });
+    }
+
+    for (auto &th: threads){
+      th.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * ops_per_thread * num_threads);
+}
+
+//looks up url paths stored as StringKeys
+template <int num_keys = 100'000, int ops_per_thread = 50'000>
+void BM_string_lookup(benchmark::State& state) {
+  const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
+  std::vector<std::string> paths = make_url_paths(num_keys, 1);
+  std::default_random_engine rng(num_threads);
+  std::uniform_int_distribution<std::size_t> dist(0, num_keys - 1);
+
+  StringArena arena;
+  std::vector<StringKey> prefill;
+  prefill.reserve(num_keys / 2);
+  for (std::size_t i = 0; i < num_keys / 2; ++i) {
+    prefill.push_back(arena.make(paths[i]));
+  }
+  std::vector<StringKey> data(ops_per_thread * num_threads);
+  std::generate(data.begin(), data.end(), [&] { return arena.make(paths[dist(rng)]); });
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    ConcurrentTree<StringKey> tree(prefill, num_threads);
+    state.ResumeTiming();
+
+    for(unsigned int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < ops_per_thread; ++j) {
+          bool b = tree.lookup(data[i * ops_per_thread + j], i);
+          benchmark::DoNotOptimize(b);
+        }
+      });
+    }
+
+    for (auto &th: threads){
+      th.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * ops_per_thread * num_threads);
+}
+
+//looks up the same url paths, but hashes them to ints first (this looses the ordering needed for range queries)
+template <int num_keys = 100'000, int ops_per_thread = 50'000>
+void BM_string_hash_lookup(benchmark::State& state) {
+  const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
+  std::vector<std::string> paths = make_url_paths(num_keys, 1);
+  std::default_random_engine rng(num_threads);
+  std::uniform_int_distribution<std::size_t> dist(0, num_keys - 1);
+
+  //0 is the sentinel of the tree
+  auto hash = [](const std::string& s) { return static_cast<int>(std::hash<std::string>{}(s) | 1); };
+  std::vector<int> prefill;
+  prefill.reserve(num_keys / 2);
+  for (std::size_t i = 0; i < num_keys / 2; ++i) {
+    prefill.push_back(hash(paths[i]));
+  }
+  std::vector<std::string> data(ops_per_thread * num_threads);
+  std::generate(data.begin(), data.end(), [&] { return paths[dist(rng)]; });
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    ConcurrentTree<int> tree(prefill, num_threads);
+    state.ResumeTiming();
+
+    for(unsigned int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < ops_per_thread; ++j) {
+          bool b = tree.lookup(hash(data[i * ops_per_thread + j]), i);
+          benchmark::DoNotOptimize(b);
+        }
+      });
+    }
+
+    for (auto &th: threads){
+      th.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * ops_per_thread * num_threads);
+}
+
+//latency of single inserts and removes while the tree is rebuilt, reported as percentiles in microseconds
+//with cooperative = false every subtree is rebuilt by each thread that reaches it on its own
+//with RebuildMode::kIncremental large subtrees are rebuilt a few chunks per operation
+template <int prefill_size = 1'000'000, int total_ops = 2'000'000, bool cooperative = true, RebuildMode mode = RebuildMode::kInline>
+void BM_rebuild_latency(benchmark::State& state) {
+  const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
+  const unsigned int ops_per_thread = total_ops / num_threads;
+  std::default_random_engine rng(num_threads);
+  std::uniform_int_distribution<> dist(1, 2 * prefill_size);
+  std::uniform_int_distribution<> opdist(1, 2);
+
+  std::vector<int> data(ops_per_thread * num_threads);
+  std::vector<int> ops(ops_per_thread * num_threads);
+  std::vector<int> prefill(prefill_size);
+  std::generate(data.begin(), data.end(), [&] { return dist(rng); });
+  std::generate(ops.begin(), ops.end(), [&] { return opdist(rng); });
+  std::generate(prefill.begin(), prefill.end(), [&] { return dist(rng); });
+
+  TreeOptions options;
+  options.rebuild_mode = mode;
+  if (!cooperative)
+    options.cooperative_rebuild_min_size = std::numeric_limits<std::size_t>::max();
+
+  std::vector<std::vector<double>> latencies(num_threads);
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    auto tree = std::make_unique<ConcurrentTree<int>>(prefill, num_threads, options);
+    state.ResumeTiming();
+
+    for(unsigned int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        latencies[i].reserve(latencies[i].size() + ops_per_thread);
+        for (unsigned int j = 0; j < ops_per_thread; ++j) {
+          int value = data[i * ops_per_thread + j];
+          auto start = std::chrono::steady_clock::now();
+          if (ops[i * ops_per_thread + j] == 1)
+            tree->insert(value, i);
+          else
+            tree->remove(value, i);
+          latencies[i].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+      });
+    }
+
+    for (auto &th: threads){
+      th.join();
+    }
+    state.PauseTiming();
+    tree.reset();
+    state.ResumeTiming();
+  }
+
+  std::vector<double> all;
+  for (const auto& l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  auto percentile = [&](double p) {
+    auto nth = all.begin() + static_cast<std::ptrdiff_t>(p * static_cast<double>(all.size() - 1));
+    std::nth_element(all.begin(), nth, all.end());
+    return *nth;
+  };
+  state.counters["p50_us"] = percentile(0.5);
+  state.counters["p99_us"] = percentile(0.99);
+  state.counters["p999_us"] = percentile(0.999);
+  state.counters["max_us"] = percentile(1.0);
+  state.SetItemsProcessed(state.iterations() * ops_per_thread * num_threads);
+}
+
 constexpr int min_threads = 1;
 constexpr int max_threads = 16;
 constexpr int iterations = 5;
+//thread ids are bits of 64 bit masks, so 63 is the most a tree supports
+constexpr int max_scaling_threads = 63;
 
 BENCHMARK(BM_insertremove<1, 1000000, 50, 25000, true>)->RangeMultiplier(2)->Range(min_threads, max_threads); // from paper
 BENCHMARK(BM_special<1, 1000000, 50, 25000, true>)->RangeMultiplier(2)->Range(min_threads, max_threads); // from paper
@@ -261,6 +690,52 @@ BENCHMARK(BM_norange<1, 1000000, 25, 50000, true>)->RangeMultiplier(2)->Range(mi
 BENCHMARK(BM_norange<1, 1000000, 50, 50000, true>)->RangeMultiplier(2)->Range(min_threads, max_threads);
 BENCHMARK(BM_norange<1, 1000000, 75, 50000, true>)->RangeMultiplier(2)->Range(min_threads, max_threads);
 
+BENCHMARK(BM_string_lookup<100000, 50000>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+BENCHMARK(BM_string_hash_lookup<100000, 50000>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+
+//root rebuilds happen after about prefill_size/2 successful operations
+BENCHMARK(BM_rebuild_latency<1000000, 2000000, true>)->RangeMultiplier(2)->Range(min_threads, max_threads)->Iterations(iterations)->UseRealTime();
+BENCHMARK(BM_rebuild_latency<1000000, 2000000, false>)->RangeMultiplier(2)->Range(min_threads, max_threads)->Iterations(iterations)->UseRealTime();
+BENCHMARK(BM_rebuild_latency<1000000, 2000000, true, RebuildMode::kIncremental>)->RangeMultiplier(2)->Range(min_threads, max_threads)->Iterations(iterations)->UseRealTime();
+BENCHMARK(BM_rebuild_latency<1000000, 2000000, true, RebuildMode::kBackground>)->RangeMultiplier(2)->Range(min_threads, max_threads)->Iterations(iterations)->UseRealTime();
+
+//rebuild policies on the mixes from above
+BENCHMARK(BM_insertremove<1, 1000000, 50, 25000, true, DepthBoundRebuildPolicy<>>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+BENCHMARK(BM_insertremove<1, 1000000, 50, 25000, true, AdaptiveRebuildPolicy>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+BENCHMARK(BM_tree<1, 1000000, 50, 100, 50000, true, DepthBoundRebuildPolicy<>>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+BENCHMARK(BM_tree<1, 1000000, 50, 100, 50000, true, AdaptiveRebuildPolicy>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+
+//fat leaves
+BENCHMARK(BM_lookup<1, 1000000, 50, 50000, true, 15>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+BENCHMARK(BM_lookup<1, 1000000, 50, 50000, true, 63>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+
+//per-thread arrays sized at compile time, every scan covers all MaxThreads slots, so compare with BM_tree<1, 1000000, 50, 100, 50000, true> at the same thread count
+BENCHMARK(BM_tree<1, 1000000, 50, 100, 50000, true, DefaultRebuildPolicy, 4>)->Arg(4);
+BENCHMARK(BM_tree<1, 1000000, 50, 100, 50000, true, DefaultRebuildPolicy, max_threads>)->Arg(max_threads);
+
+//sharding against the single tree it replaces, up to max_scaling_threads threads
+BENCHMARK(BM_tree<1, 1000000, 50, 100, 20000, true>)->RangeMultiplier(2)->Range(min_threads, 32)->Arg(max_scaling_threads)->UseRealTime();
+BENCHMARK(BM_sharded<1, 1000000, 50, 100, 20000, 16>)->RangeMultiplier(2)->Range(min_threads, 32)->Arg(max_scaling_threads)->UseRealTime();
+BENCHMARK(BM_sharded<1, 1000000, 50, 100, 20000, 64>)->RangeMultiplier(2)->Range(min_threads, 32)->Arg(max_scaling_threads)->UseRealTime();
+
+//hot keys
+BENCHMARK(BM_zipf<1000000, 99, 50000, false>)->RangeMultiplier(2)->Range(min_threads, max_threads)->UseRealTime();
+BENCHMARK(BM_zipf<1000000, 99, 50000, true>)->RangeMultiplier(2)->Range(min_threads, max_threads)->UseRealTime();
+
+//one and two threads, where most reads find the tree without other operations
+BENCHMARK(BM_uncontended<1000000, 200000, false>)->DenseRange(1, 2)->UseRealTime();
+BENCHMARK(BM_uncontended<1000000, 200000, true>)->DenseRange(1, 2)->UseRealTime();
+
+//timestamp sources, the counter is written by every operation, so the difference grows with the number of cores
+BENCHMARK(BM_timestamps<1000000, 20000, TimestampSource::kCounter>)->RangeMultiplier(2)->Range(min_threads, 32)->Arg(max_scaling_threads)->UseRealTime();
+BENCHMARK(BM_timestamps<1000000, 20000, TimestampSource::kTsc>)->RangeMultiplier(2)->Range(min_threads, 32)->Arg(max_scaling_threads)->UseRealTime();
+
+//node layout, 50M plain nodes take tens of GB (every node has its own queue), so the large tree uses fat leaves
+BENCHMARK(BM_layout_lookup<1000000, 50000, false>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+BENCHMARK(BM_layout_lookup<1000000, 50000, true>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+BENCHMARK(BM_layout_lookup<50000000, 50000, false, 63>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+BENCHMARK(BM_layout_lookup<50000000, 50000, true, 63>)->RangeMultiplier(2)->Range(min_threads, max_threads);
+
 // //NO REBUILD FROM HERE
 
 BENCHMARK(BM_insertremove<1, 1000000, 50, 25000, false>)->RangeMultiplier(2)->Range(min_threads, max_threads); // from paper
@@ -0,0 +1,94 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "implementation/hazard_pointers.hpp"
+#include "implementation/thread_slots.hpp"
+#include "implementation/waitfree_queue.hpp"
+
+//every thread only writes its own slot, so any slowdown with more threads comes from slots sharing cache lines
+template <bool padded = true, int ops_per_thread = 10'000'000>
+void BM_slot_writes(benchmark::State& state) {
+  const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
+
+  for (auto _ : state) {
+    ThreadSlots<boost::atomic<std::uint64_t>, 0, padded> slots(num_threads);
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (unsigned int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < ops_per_thread; ++j) {
+          slots[i].store(static_cast<std::uint64_t>(j), boost::memory_order_release);
+        }
+      });
+    }
+    for (auto& th : threads) {
+      th.join();
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * ops_per_thread * num_threads);
+}
+
+//the pattern of the queues, every thread publishes a hazard pointer before each access
+template <bool padded = true, int ops_per_thread = 10'000'000>
+void BM_hazard_pointers(benchmark::State& state) {
+  const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
+  std::vector<int> values(num_threads);
+
+  for (auto _ : state) {
+    HazardPointers<int, 0, 0, padded> hp(3, num_threads);
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (unsigned int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < ops_per_thread; ++j) {
+          hp.protectPtr(j % 3, &values[i], i);
+        }
+        hp.clear(i);
+      });
+    }
+    for (auto& th : threads) {
+      th.join();
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * ops_per_thread * num_threads);
+}
+
+//push and pop on a shared queue, which reads the announcements of all threads while helping
+template <bool padded = true, int ops_per_thread = 200'000>
+void BM_queue(benchmark::State& state) {
+  const unsigned int num_threads = static_cast<unsigned int>(state.range(0));
+
+  for (auto _ : state) {
+    WaitFreeQueue<int, 0, padded> queue(num_threads);
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (unsigned int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < ops_per_thread; ++j) {
+          queue.push(j + 1, i);
+          benchmark::DoNotOptimize(queue.pop(i));
+        }
+      });
+    }
+    for (auto& th : threads) {
+      th.join();
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * ops_per_thread * num_threads * 2);
+}
+
+constexpr int min_threads = 1;
+constexpr int max_threads = 16;
+
+BENCHMARK(BM_slot_writes<true>)->RangeMultiplier(2)->Range(min_threads, max_threads)->UseRealTime();
+BENCHMARK(BM_slot_writes<false>)->RangeMultiplier(2)->Range(min_threads, max_threads)->UseRealTime();
+BENCHMARK(BM_hazard_pointers<true>)->RangeMultiplier(2)->Range(min_threads, max_threads)->UseRealTime();
+BENCHMARK(BM_hazard_pointers<false>)->RangeMultiplier(2)->Range(min_threads, max_threads)->UseRealTime();
+BENCHMARK(BM_queue<true>)->RangeMultiplier(2)->Range(min_threads, max_threads)->UseRealTime();
+BENCHMARK(BM_queue<false>)->RangeMultiplier(2)->Range(min_threads, max_threads)->UseRealTime();
@@ -0,0 +1,79 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <vector>
+#include <filesystem>
+#include <string>
+#include <random>
+#include <span>
+
+#include "implementation/concurrent_tree.hpp"
+
+//builds a tree from unsorted keys with the vector constructor
+void BM_construct(benchmark::State& state) {
+  const std::size_t num_keys = static_cast<std::size_t>(state.range(0));
+  const std::size_t build_threads = static_cast<std::size_t>(state.range(1));
+  std::default_random_engine rng(42);
+  std::uniform_int_distribution<> dist(1, std::numeric_limits<int>::max());
+
+  std::vector<int> keys(num_keys);
+  std::generate(keys.begin(), keys.end(), [&] { return dist(rng); });
+
+  for (auto _ : state) {
+    auto tree = std::make_unique<ConcurrentTree<int>>(keys, 1, TreeOptions{.build_threads = build_threads});
+    benchmark::ClobberMemory();
+    //destruction is not part of the startup time
+    state.PauseTiming();
+    tree.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(num_keys));
+}
+
+//builds a tree from already sorted keys with the span constructor, which skips the copy and sort
+void BM_construct_sorted(benchmark::State& state) {
+  const std::size_t num_keys = static_cast<std::size_t>(state.range(0));
+  const std::size_t build_threads = static_cast<std::size_t>(state.range(1));
+
+  std::vector<int> keys(num_keys);
+  std::iota(keys.begin(), keys.end(), 1);
+
+  for (auto _ : state) {
+    auto tree = std::make_unique<ConcurrentTree<int>>(std::span<const int>(keys), 1, TreeOptions{.build_threads = build_threads});
+    benchmark::ClobberMemory();
+    state.PauseTiming();
+    tree.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(num_keys));
+}
+
+//loads a tree from a memory mapped snapshot file
+void BM_load(benchmark::State& state) {
+  const std::size_t num_keys = static_cast<std::size_t>(state.range(0));
+  const std::size_t build_threads = static_cast<std::size_t>(state.range(1));
+  const std::string path = (std::filesystem::temp_directory_path() / "wait_free_tree_bench_snapshot.bin").string();
+
+  {
+    std::vector<int> keys(num_keys);
+    std::iota(keys.begin(), keys.end(), 1);
+    ConcurrentTree<int> tree(std::span<const int>(keys), 1);
+    tree.save(path);
+  }
+
+  for (auto _ : state) {
+    auto tree = ConcurrentTree<int>::load(path, 1, TreeOptions{.build_threads = build_threads});
+    benchmark::ClobberMemory();
+    state.PauseTiming();
+    tree.reset();
+    state.ResumeTiming();
+  }
+  std::filesystem::remove(path);
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(num_keys));
+}
+
+BENCHMARK(BM_construct)->ArgsProduct({{1'000'000, 10'000'000, 100'000'000}, {1, 4, 16}})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_construct_sorted)->ArgsProduct({{1'000'000, 10'000'000, 100'000'000}, {1, 4, 16}})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_load)->ArgsProduct({{1'000'000, 10'000'000, 100'000'000}, {1, 4, 16}})->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -3,16 +3,31 @@
 #include "conditional_q.hpp"
 #include "waitfree_queue.hpp"
 #include "tree_internals.hpp"
+#include "rebuild_policy.hpp"
 
 #include "hazard_pointers.hpp"
+#include "parallel_sort.hpp"
+#include "snapshot.hpp"
+#include "thread_slots.hpp"
 
 #include <vector>
 #include <cstdint>
 #include <memory>
 #include <algorithm>
+#include <bit>
+#include <chrono>
 #include <queue>
+#include <unordered_map>
 #include <iostream>
 #include <limits>
+#include <optional>
+#include <stdexcept>
+#include <span>
+#include <string>
+#include <thread>
+#include <stop_token>
+#include <tuple>
+#include <type_traits>
 
 #include <boost/atomic/atomic.hpp>
 
@@ -20,46 +35,62 @@
 /**
  * Implementation of the Wait-free Trees with Asymptotically-Efficient Range Queries proposed by Kokorin, Yudov, Aksenov, and Alistarh
  * The wait-freeness is somewhat destroyed by 128bit atomics not working with gcc and the tree node deallocation scheme, which is not bounded.
+ * RebuildPolicy decides when a subtree is rebuilt, see rebuild_policy.hpp
+ * With MaxThreads > 0 the per-thread arrays of the tree and its queues are stored inline and the constructors
+ * throw std::invalid_argument if more than MaxThreads threads (including background workers) are requested.
  */
-template <class T, bool rebuild_b = true>
+template <class T, bool rebuild_b = true, class RebuildPolicy = DefaultRebuildPolicy, std::size_t MaxThreads = 0>
 class ConcurrentTree {
 public:
 
   /**
    * Creates an empty tree that allows concurrent access by max_threads threads
    */
-  ConcurrentTree(std::size_t max_threads) : max_threads_(max_threads), fake_root_q(max_threads_), ops_(max_threads_), delete_mask_((static_cast<std::uint64_t>(1)<<max_threads_)-1), to_be_deleted_(max_threads_), hp_op(max_threads_, max_threads_)  {
+  ConcurrentTree(std::size_t max_threads, TreeOptions options = {}) : max_threads_(max_threads + background_threads(options)), options_(options), rebuild_policy_(max_threads_), fake_root_q(max_threads_, 0, options.timestamp_source), ops_(max_threads_), delete_mask_((static_cast<std::uint64_t>(1)<<max_threads_)-1), to_be_deleted_(max_threads_), hp_op(max_threads_, max_threads_)  {
+    if (options_.leaf_block_size > LeafBlock<T>::kMaxSize)
+      throw std::invalid_argument("Leaf blocks can hold at most 64 values");
+    if (options_.leaf_block_size > 0 && options_.rebuild_mode != RebuildMode::kInline)
+      throw std::invalid_argument("Leaf blocks are only supported with RebuildMode::kInline");
+    if (options_.timestamp_source == TimestampSource::kTsc && !invariant_tsc_supported())
+      throw std::invalid_argument("TimestampSource::kTsc requires an invariant TSC");
     for (std::size_t i = 0; i < max_threads_; ++i) {
-      ops_[i].store(nullptr);
+      ops_[i].store(nullptr, boost::memory_order_relaxed);
+    }
+    if (options_.build_threads == 0)
+      options_.build_threads = std::max(1u, std::thread::hardware_concurrency());
+    //rebuilds allocate whole arenas, so recycled nodes would never be reused
+    if (options_.veb_layout)
+      options_.node_pool_size = 0;
+    //the workers use the thread ids after the ones of the callers
+    for (std::size_t i = max_threads; i < max_threads_; ++i) {
+      workers_.emplace_back([this, i](std::stop_token stop) { background_worker(stop, i); });
     }
   }
 
   /**
    * Creates a tree that allows concurrent access by max_threads threads
    * The tree will contain the values in the initial_values vector
+   * Sorting and building the tree is done by options.build_threads threads
    */
-  ConcurrentTree(std::vector<T> initial_values, std::size_t max_threads) : max_threads_(max_threads), fake_root_q(max_threads_), ops_(max_threads_), delete_mask_((static_cast<std::uint64_t>(1)<<max_threads_)-1), to_be_deleted_(max_threads_), hp_op(max_threads_, max_threads_)  {
-    for (std::size_t i = 0; i < max_threads_; ++i) {
-      ops_[i].store(nullptr);
-    }
-    std::sort(initial_values.begin(), initial_values.end());
-    fake_root_child.store(build_tree(initial_values, 0, initial_values.size() - 1, 1));
+  ConcurrentTree(std::vector<T> initial_values, std::size_t max_threads, TreeOptions options = {}) : ConcurrentTree(max_threads, options) {
+    parallel_sort(std::span<T>(initial_values), options_.build_threads);
+    build_initial_tree(initial_values);
+  }
+
+  /**
+   * Creates a tree that allows concurrent access by max_threads threads
+   * The tree will contain the values in sorted_values, which have to be sorted in ascending order already
+   * The values are not copied, so this avoids the copy and sort of the vector constructor
+   */
+  ConcurrentTree(std::span<const T> sorted_values, std::size_t max_threads, TreeOptions options = {}) : ConcurrentTree(max_threads, options) {
+    build_initial_tree(sorted_values);
   }
   
   ~ConcurrentTree() {
+    workers_.clear();
+
     //delete the remaining nodes of the tree
-    std::queue<pNode> q;
-    q.push(fake_root_child.load());
-    while (!q.empty()) {
-      auto n = q.front();
-      q.pop();
-      if (n->left_child.load() != nullptr)
-        q.push(n->left_child.load());
-      if (n->right_child.load() != nullptr)
-        q.push(n->right_child.load());
-      std::atomic_thread_fence(std::memory_order_seq_cst);
-      delete n;
-    }
+    delete_tree(fake_root_child.load());
     
     //delete the remaining nodes that are marked to be deleted
     auto p1 = to_be_deleted_.pop(0);
@@ -67,6 +98,12 @@ public:
       delete_tree(p1.node);
       p1 = to_be_deleted_.pop(0);
     }
+
+    for (auto& pool : node_pools_) {
+      for (pNode n : pool.nodes) {
+        delete n;
+      }
+    }
   }
 
   /*
@@ -81,13 +118,14 @@ public:
     if (value == T{})
       return false;
 
+    rebuild_policy_.record_write(tid);
     pOp new_op = new Op(max_threads_, OperationType::kInsert, value);
     ops_[tid].store(new_op);
     add_ops_to_root(tid);
 
     do_op(tid);
 
-    ops_[tid].store(nullptr);
+    ops_[tid].store(nullptr, boost::memory_order_release);
     bool result = new_op->success;
     hp_op.retire(new_op, tid);
 
@@ -101,13 +139,14 @@ public:
   void remove(const T value, const std::size_t tid) {
     set_mask_.fetch_and(~(static_cast<std::uint64_t>(1)<<tid));
 
+    rebuild_policy_.record_write(tid);
     pOp new_op = new Op(max_threads_, OperationType::kRemove, value);
     ops_[tid].store(new_op);
     add_ops_to_root(tid);
 
     do_op(tid);
 
-    ops_[tid].store(nullptr);
+    ops_[tid].store(nullptr, boost::memory_order_release);
     hp_op.retire(new_op, tid);
   }
 
@@ -115,6 +154,10 @@ public:
    * Returns true if value is part of the tree, false if it is not
    */
   [[nodiscard]] bool lookup(const T value, const std::size_t tid) {
+    rebuild_policy_.record_read(tid);
+    if (std::optional<bool> result = read_uncontended([&] { return lookup_directly(value); }, tid))
+      return *result;
+
     set_mask_.fetch_and(~(static_cast<std::uint64_t>(1)<<tid));
 
     pOp new_op = new Op(max_threads_, OperationType::kLookup, value);
@@ -122,7 +165,7 @@ public:
     add_ops_to_root(tid);
 
     do_op(tid);
-    ops_[tid].store(nullptr);
+    ops_[tid].store(nullptr, boost::memory_order_release);
 
     bool result = new_op->success;
 
@@ -139,50 +182,230 @@ public:
       return lookup(lower, tid);
     }
 
+    rebuild_policy_.record_read(tid);
+    if (std::optional<std::uint32_t> result = read_uncontended([&] { return range_count_directly(lower, upper); }, tid))
+      return *result;
+
     set_mask_.fetch_and(~(static_cast<std::uint64_t>(1)<<tid));
 
-    pOp new_op = new Op(max_threads_, OperationType::kRangeCount, lower, upper);
+    pOp new_op = new RangeOp(max_threads_, lower, upper);
     ops_[tid].store(new_op);
     add_ops_to_root(tid);
 
     std::uint32_t result = do_op(tid);
-    ops_[tid].store(nullptr);
+    ops_[tid].store(nullptr, boost::memory_order_release);
 
     hp_op.retire(new_op, tid);
 
     return result;
   }
 
+  /**
+   * Writes all values of the tree in ascending order to a snapshot file at path
+   * Must not be called concurrently with other operations on the tree
+   * The keys are written bytewise, so T must not contain pointers (like StringKey)
+   * Throws std::system_error if the file can not be written
+   */
+  void save(const std::string& path) const {
+    std::vector<T> values;
+    std::vector<pNode> stack;
+    pNode n = fake_root_child.load();
+    //in-order traversal, so the values are already sorted
+    while (n != nullptr || !stack.empty()) {
+      if (n != nullptr && n->block != nullptr) {
+        //the block of a fat leaf has to be merged with the values below it
+        append_fat_leaf(n, nullptr, nullptr, values);
+        n = nullptr;
+      } else if (n != nullptr) {
+        stack.push_back(n);
+        n = n->left_child.load();
+      } else {
+        n = stack.back();
+        stack.pop_back();
+        if (n->state.load().get_active())
+          values.push_back(n->value);
+        n = n->right_child.load();
+      }
+    }
+    write_snapshot(path, std::span<const T>(values));
+  }
+
+  /**
+   * Creates a tree that allows concurrent access by max_threads threads from a snapshot file written by save
+   * The file is memory mapped and the keys are used to build the tree directly, without copying or sorting them
+   * Throws std::system_error or std::runtime_error if the file can not be read or is not a valid snapshot for T
+   */
+  static std::unique_ptr<ConcurrentTree> load(const std::string& path, std::size_t max_threads, TreeOptions options = {}) {
+    MappedSnapshot<T> snapshot(path);
+    return std::make_unique<ConcurrentTree>(snapshot.keys(), max_threads, options);
+  }
+
+  /**
+   * Moves all values >= key into a new tree, which is returned, and keeps the values < key in this tree
+   * Only the nodes on the path to key are relinked, so this takes O(height) time
+   * Must not be called concurrently with other operations on the tree
+   * Throws std::invalid_argument if the tree uses leaf blocks
+   */
+  std::unique_ptr<ConcurrentTree> split_at(const T key) {
+    if (options_.leaf_block_size > 0)
+      throw std::invalid_argument("Trees with leaf blocks can not be split");
+    auto other = std::make_unique<ConcurrentTree>(max_threads_ - background_threads(options_), options_);
+    std::pair<pNode, pNode> lower_upper = split_subtree(fake_root_child.load(), key);
+    fake_root_child.store(lower_upper.first);
+    other->fake_root_child.store(lower_upper.second);
+    //the moved nodes carry timestamps of this tree
+    other->last_timestamp_.store(last_timestamp_.load());
+    return other;
+  }
+
+  /**
+   * Moves all values of other into this tree, other is empty afterwards
+   * The values of both trees have to be in disjoint ranges, i.e. all values of one tree are smaller than all values of the other one
+   * The trees are joined below the boundary paths, so this takes O(height) time
+   * Must not be called concurrently with other operations on either tree
+   * Throws std::invalid_argument if the ranges overlap, the trees were created for a different number of threads or timestamp source or use leaf blocks
+   */
+  void merge(ConcurrentTree& other) {
+    if (other.max_threads_ != max_threads_)
+      throw std::invalid_argument("Trees with a different number of threads can not be merged");
+    if (options_.leaf_block_size > 0 || other.options_.leaf_block_size > 0)
+      throw std::invalid_argument("Trees with leaf blocks can not be merged");
+    if (other.options_.timestamp_source != options_.timestamp_source)
+      throw std::invalid_argument("Trees with different timestamp sources can not be merged");
+
+    pNode a = fake_root_child.load();
+    pNode b = other.fake_root_child.load();
+    if (b == nullptr)
+      return;
+    if (a == nullptr) {
+      fake_root_child.store(b);
+    } else if (max_node(a)->value < min_node(b)->value) {
+      fake_root_child.store(join(a, b));
+    } else if (max_node(b)->value < min_node(a)->value) {
+      fake_root_child.store(join(b, a));
+    } else {
+      throw std::invalid_argument("Only trees with disjoint value ranges can be merged");
+    }
+    other.fake_root_child.store(nullptr);
+    last_timestamp_.store(std::max(last_timestamp_.load(), other.last_timestamp_.load()));
+  }
+
   void print_atomic_capabilities() {
     to_be_deleted_.print_atomic_capabilities();
     fake_root_q.print_atomic_capabilities();
     boost::atomic<NodeState> a = NodeState(0, 0, 0);
     std::cout << "NodeState: " << a.is_lock_free() << std::endl;
     std::cout << "Nodestate size: " << sizeof(NodeState) << std::endl;
-    std::cout << "Node<T> size: " << sizeof(Node<T>) << std::endl;
+    std::cout << "Node<T> size: " << sizeof(Node<T, MaxThreads>) << std::endl;
   }
 
 private:
-  using Op = Operation<T>;
+  using Op = Operation<T, MaxThreads>;
   using pOp = Op *;
+  using RangeOp = RangeOperation<T, MaxThreads>;
+  using pRangeOp = RangeOp *;
+  //the struct an operation of type is stored in
+  template <OperationType type>
+  using OpOf = std::conditional_t<type == OperationType::kRangeCount, pRangeOp, pOp>;
   using pState = NodeState *;
-  using pNode = Node<T> *;
+  using pNode = Node<T, MaxThreads> *;
+  using LogEntry = typename RebuildDescriptor<T, MaxThreads>::LogEntry;
 
   std::size_t max_threads_ = 1;
+  TreeOptions options_;
+  RebuildPolicy rebuild_policy_;
 
   boost::atomic<pNode> fake_root_child = nullptr;
-  ConditionalQ<Op> fake_root_q;
+  ConditionalQ<Op, MaxThreads> fake_root_q;
 
-  std::vector<boost::atomic<pOp>> ops_;
+  ThreadSlots<boost::atomic<pOp>, MaxThreads> ops_;
 
   boost::atomic<std::uint64_t> last_timestamp_ = 1;
 
   const std::uint64_t delete_mask_;
   boost::atomic<std::uint64_t> set_mask_ = 0;
-  WaitFreeQueue<NodeRemoveFlags<T>> to_be_deleted_;
+  WaitFreeQueue<NodeRemoveFlags<T, MaxThreads>, MaxThreads> to_be_deleted_;
   boost::atomic<std::uint64_t> to_be_deleted_num_ = 0;
 
-  HazardPointers<Op> hp_op;
+  HazardPointers<Op, MaxThreads, MaxThreads> hp_op;
+
+  //retired nodes that no thread can access anymore, every thread reuses its own ones in rebuilds
+  struct alignas(64) NodePool {
+    std::vector<pNode> nodes;
+  };
+  std::vector<NodePool> node_pools_{max_threads_};
+
+  //containers of the operation path of every thread, which are reused so operations do not allocate them each time
+  struct alignas(64) Scratch {
+    std::vector<pOp> to_insert;
+    //nodes a range count visited with the count pushed with them and their position, only the first count of a node is used
+    std::vector<std::tuple<pNode, std::size_t, std::uint32_t>> results;
+    //shared by nested calls of finish_subtree, every call only uses the entries above the size it started with
+    std::vector<pNode> subtree_stack;
+    //number of reads that skip read_uncontended after it discarded a read
+    std::uint32_t uncontended_backoff = 0;
+  };
+  std::vector<Scratch> scratch_{max_threads_};
+  static constexpr std::uint32_t kUncontendedBackoff = 16;
+
+  //values of the roots of subtrees whose rebuild was handed to the background workers
+  WaitFreeQueue<T, MaxThreads> rebuild_requests_{max_threads_};
+  //has to be the last member, so the workers are stopped before anything else is destroyed
+  std::vector<std::jthread> workers_;
+
+  /**
+   * Number of additional thread ids used by the background workers
+   */
+  static std::size_t background_threads(const TreeOptions& options) {
+    return options.rebuild_mode == RebuildMode::kBackground ? std::max<std::size_t>(options.background_threads, 1) : 0;
+  }
+
+  /**
+   * Main loop of a background worker, which finishes the rebuilds in rebuild_requests_ until it is stopped
+   */
+  void background_worker(std::stop_token stop, const std::size_t tid) {
+    while (!stop.stop_requested()) {
+      set_mask_.fetch_and(~(static_cast<std::uint64_t>(1)<<tid));
+      T value = rebuild_requests_.pop(tid);
+      if (value == T{}) {
+        set_mask_.fetch_or(1<<tid);
+        std::this_thread::yield();
+        continue;
+      }
+      background_rebuild(value, tid);
+      release_nodes(tid);
+    }
+  }
+
+  /**
+   * Finish and link the rebuild of the subtree rooted at the node with the given value
+   * The node is looked up again, as it could have been replaced since the request was made
+   */
+  void background_rebuild(const T value, const std::size_t tid) {
+    boost::atomic<pNode>* link = &fake_root_child;
+    pNode n = link->load();
+    while (n != nullptr && n->value != value) {
+      link = value < n->value ? &n->left_child : &n->right_child;
+      n = link->load();
+    }
+    if (n == nullptr)
+      return;
+    RebuildDescriptor<T, MaxThreads>* desc = n->rebuild.load();
+    if (desc == nullptr || !desc->confirmed.load())
+      return;
+    rebuild_steps(n, desc, std::numeric_limits<std::size_t>::max(), tid);
+    install_incremental_rebuild(*link, n, desc, tid);
+  }
+
+  /**
+   * Returns a timestamp that is larger than all timestamps taken before, from last_timestamp_ or the TSC
+   * Every timestamp is taken after the operation it is assigned to was announced, which add_ops_to_root relies on
+   */
+  std::uint64_t next_timestamp(const std::size_t tid) {
+    if (options_.timestamp_source == TimestampSource::kTsc)
+      return tsc_timestamp(tid);
+    return last_timestamp_.fetch_add(1);
+  }
 
   /**
    * Insert the operation of thread tid into the root queue
@@ -190,20 +413,23 @@ private:
    * This is to maintain the ordering of the operations
    */
   void add_ops_to_root(std::size_t tid) {
-    std::vector<pOp> to_insert;
+    std::vector<pOp>& to_insert = scratch_[tid].to_insert;
+    to_insert.clear();
     std::uint64_t own_timestamp = 0;
-    std::uint64_t new_timestamp = last_timestamp_.fetch_add(1);
+    std::uint64_t new_timestamp = next_timestamp(tid);
     if (ops_[tid].load()->timestamp.compare_exchange_strong(own_timestamp, new_timestamp)) { //this op can only be freed by this thread -> no hp
       own_timestamp = new_timestamp;
     }
     to_insert.push_back(ops_[tid].load());
     for (std::size_t i = 0; i < max_threads_; ++i) {
-      pOp a = hp_op.protectPtr(i, ops_[i].load(), tid);
+      //most threads have nothing announced, which needs no hazard pointer
+      pOp a = ops_[i].load();
       if (a == nullptr)
         continue;
+      hp_op.protectPtr(i, a, tid);
       if (a == ops_[i].load()) {
         std::size_t check_timestamp = 0;
-        new_timestamp = last_timestamp_.fetch_add(1);
+        new_timestamp = next_timestamp(tid);
         if(!a->timestamp.compare_exchange_strong(check_timestamp, new_timestamp)) {
           if (check_timestamp < own_timestamp) {
             to_insert.push_back(a);
@@ -211,11 +437,9 @@ private:
         }
       }
     }
-    // try to push in sorted order to maintain ordering of operations 
+    // push in sorted order to maintain ordering of operations, all at once so there is only one helping round
     std::sort(to_insert.begin(), to_insert.end(), [](pOp a, pOp b) {return a->timestamp < b->timestamp;});
-    for (auto a : to_insert) {
-      fake_root_q.push_if(a, tid);
-    }
+    fake_root_q.push_if_batch(to_insert, tid);
 
     hp_op.clear(tid);
   }
@@ -224,17 +448,21 @@ private:
    * Complete the operation of tid by executing the action in all nodes that the operation has to visit
    */
   std::uint32_t do_op(const std::size_t tid) { 
-    std::unordered_map<pNode, std::uint32_t> results;
+    auto& results = scratch_[tid].results;
+    results.clear();
     pOp own_op = ops_[tid].load();
+    const bool count = own_op->type == OperationType::kRangeCount;
     //do in root q
     execute_until_timestamp_root(own_op->timestamp, tid);
     
     //do in other q's
     std::pair<pNode, std::uint32_t> n_r = std::pair<pNode, std::uint32_t>{};
     while ((n_r = own_op->to_visit.pop(tid)) != std::pair<pNode, std::uint32_t>{}) {
-      if (!results.contains(n_r.first)) { 
-        results.insert({n_r.first, n_r.second});
-      }
+      if (count)
+        results.emplace_back(n_r.first, results.size(), n_r.second);
+      //the count of a leaf block, there is nothing to execute
+      if (is_block_entry(n_r.first))
+        continue;
       execute_until_timestamp(n_r.first, own_op->timestamp, tid);
     }
     // if (!own_op->success) {
@@ -251,17 +479,29 @@ private:
     // }
 
     //collect results, this is only relevant for the range count query
+    //a node can be pushed by several helpers, sorting puts its first entry in front of the others
+    std::sort(results.begin(), results.end());
     std::uint32_t result = 0;
-    for (auto p : results) {
-      result += p.second;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      if (i == 0 || std::get<0>(results[i]) != std::get<0>(results[i-1]))
+        result += std::get<2>(results[i]);
     }
-    result += own_op->lower_count.load() + own_op->upper_count.load();
+    if (count)
+      result += static_cast<pRangeOp>(own_op)->lower_count.load() + static_cast<pRangeOp>(own_op)->upper_count.load();
+
+    release_nodes(tid);
+    return result;
+  }
 
+  /**
+   * Marks that tid does not access any nodes anymore and deletes the nodes that no thread can access anymore
+   */
+  void release_nodes(const std::size_t tid) {
     //iterate through nodes that are marked to be deleted, now that this thread access no nodes anymore
     set_mask_.fetch_or(1<<tid);
 
     //this kills the wait-freenes, a const amount of iterations that keep the size of to_be_deleted_ small would better
-    std::uint64_t max_delete = to_be_deleted_num_.load();
+    std::uint64_t max_delete = to_be_deleted_num_.load(boost::memory_order_relaxed);
     for (std::uint64_t i = 0; i < max_delete; ++i) {
       auto p = to_be_deleted_.pop(tid);
       if (p.node == nullptr) {
@@ -269,43 +509,163 @@ private:
       }
       p.remove_flags |= set_mask_.load();
       if (p.remove_flags == delete_mask_) {
-        delete_tree(p.node);
-        to_be_deleted_num_.fetch_sub(1);
+        recycle_tree(p.node, tid);
+        to_be_deleted_num_.fetch_sub(1, boost::memory_order_relaxed);
       } else {
         to_be_deleted_.push(p, tid);
       }
     }
+  }
+
+  /**
+   * Runs read on the tree directly, without announcing an operation, if no operation is in flight
+   * Operations only change the tree after they got a timestamp, so if none was announced and last_timestamp_ did not change
+   * until read is done, it saw the tree as it is after all operations with a smaller timestamp and is linearized with them.
+   * Otherwise std::nullopt is returned and the caller falls back to the wait-free path. After a read was discarded,
+   * the next kUncontendedBackoff reads of this thread use the wait-free path right away, as the tree is probably contended.
+   * Direct reads do not pass the nodes, so they do not trigger rebuilds, the next update on the path does.
+   */
+  template <class F>
+  std::optional<std::invoke_result_t<F>> read_uncontended(F&& read, const std::size_t tid) {
+    //with the TSC, last_timestamp_ does not show other operations
+    if (!options_.uncontended_reads || options_.timestamp_source != TimestampSource::kCounter)
+      return std::nullopt;
+    Scratch& scratch = scratch_[tid];
+    if (scratch.uncontended_backoff > 0) {
+      --scratch.uncontended_backoff;
+      return std::nullopt;
+    }
+
+    const std::uint64_t timestamp = last_timestamp_.load();
+    for (std::size_t i = 0; i < max_threads_; ++i) {
+      if (ops_[i].load() != nullptr)
+        return std::nullopt;
+    }
+    //the nodes are protected like in every other operation
+    set_mask_.fetch_and(~(static_cast<std::uint64_t>(1)<<tid));
+    std::optional<std::invoke_result_t<F>> result = read();
+    if (last_timestamp_.load() != timestamp) {
+      scratch.uncontended_backoff = kUncontendedBackoff;
+      return std::nullopt;
+    }
+    release_nodes(tid);
+    return result;
+  }
+
+  /**
+   * Lookup on a tree without pending operations, which gives the same result as do_root_lookup, do_node_lookup and do_block_op
+   */
+  bool lookup_directly(const T value) const {
+    pNode n = fake_root_child.load();
+    while (n != nullptr) {
+      if (n->value == value)
+        return n->state.load().get_active();
+      if (n->block != nullptr) {
+        int index = n->block->find(value);
+        if (index >= 0)
+          return (n->block->state.load().active & (std::uint64_t{1} << index)) != 0;
+      }
+      n = value < n->value ? n->left_child.load() : n->right_child.load();
+    }
+    return false;
+  }
+
+  /**
+   * Range count on a tree without pending operations, which follows the same paths and adds the same counts as
+   * do_root_rangecount, do_node_rangecount and handle_split_query, so both give the same result for the same tree
+   */
+  std::uint32_t range_count_directly(const T lower, const T upper) const {
+    std::uint32_t result = 0;
+    pNode n = fake_root_child.load();
+    //the path to the split point, only blocks count here
+    while (n != nullptr && (n->value < lower || n->value > upper)) {
+      result += block_count(n, lower, upper);
+      n = n->value > upper ? n->left_child.load() : n->right_child.load();
+    }
+    if (n == nullptr)
+      return result;
+
+    result += 1 + block_count(n, lower, upper);
+    pNode child = n->left_child.load();
+    if (child != nullptr && n->value != lower)
+      result += (child->value >= lower) + count_split_path(child, lower, upper, lower, true, std::greater<>{});
+    child = n->right_child.load();
+    if (child != nullptr && n->value != upper)
+      result += (child->value <= upper) + count_split_path(child, lower, upper, upper, false, std::less<>{});
+    return result;
+  }
+
+  /**
+   * The part of range_count_directly below the split point, starting at n in the lower (lower_half) or upper half, see handle_split_query
+   * The count for n itself was already added by the caller
+   */
+  template <class Compare>
+  static std::uint32_t count_split_path(pNode n, const T lower, const T upper, const T comp_value, const bool lower_half, Compare&& comp) {
+    std::uint32_t result = 0;
+    while (n != nullptr) {
+      result += block_count(n, lower, upper);
+      const pNode inner_child = lower_half ? n->right_child.load() : n->left_child.load();
+      const pNode outer_child = lower_half ? n->left_child.load() : n->right_child.load();
+      const std::uint32_t inner_child_size = inner_child != nullptr ? inner_child->state.load().all_children : 0;
+      if (comp(n->value, comp_value)) {
+        result += inner_child_size;
+        if (outer_child != nullptr)
+          result += comp(outer_child->value, comp_value) || outer_child->value == comp_value;
+        n = outer_child;
+      } else if (n->value == comp_value) {
+        return result + inner_child_size;
+      } else {
+        if (inner_child != nullptr)
+          result += comp(inner_child->value, comp_value) || inner_child->value == comp_value;
+        n = inner_child;
+      }
+    }
     return result;
   }
 
+  /**
+   * Active values of the block of n in [lower, upper], 0 if n has no block
+   */
+  static std::uint32_t block_count(const pNode n, const T lower, const T upper) {
+    if (n->block == nullptr)
+      return 0;
+    return static_cast<std::uint32_t>(std::popcount(n->block->range_mask(lower, upper) & n->block->state.load().active));
+  }
+
   /**
    * Execute actions in the (fake) root node until the given timestamp is reached
    */
   void execute_until_timestamp_root(const std::uint64_t timestamp, const std::size_t tid) {
     pOp a;
     while (true) {
-      a = hp_op.protectPtr(0, fake_root_q.peek(tid), tid);
-      if (a != fake_root_q.peek(tid)) 
-        continue;
-
+      a = fake_root_q.peek_protected(hp_op, 0, tid);
       if (a == nullptr) break;
       if (a->timestamp > timestamp) break;
 
+      //child an update has to be pushed to, as it was logged by its incremental rebuild
+      pNode route = nullptr;
       if (rebuild_b) {
-        if (!rebuild_root(a->timestamp, tid))
+        if (!rebuild_root(a, route, tid))
           continue;
       }
 
-      if (a->type == OperationType::kInsert) {
-        do_root_insert(a, tid);
-      } else if (a->type == OperationType::kRemove) {
-        do_root_remove(a, tid);
-      } else if (a->type == OperationType::kLookup) {
-        do_root_lookup(a, tid);
-      } else if (a->type == OperationType::kRangeCount) {
-        do_root_rangecount(a, tid);
+      if (options_.root_elimination && eliminate_at_root(a, tid)) {
+        fake_root_q.pop_if(a->timestamp, tid);
+        hp_op.clearOne(0, tid);
+        continue;
       }
 
+      dispatch(a, [&]<OperationType type>(const OpOf<type> op) {
+        if constexpr (type == OperationType::kInsert)
+          do_root_insert(op, tid, route);
+        else if constexpr (type == OperationType::kRemove)
+          do_root_remove(op, tid, route);
+        else if constexpr (type == OperationType::kLookup)
+          do_root_lookup(op, tid);
+        else
+          do_root_rangecount(op, tid);
+      });
+
       hp_op.clearOne(0, tid);
     }
   }
@@ -316,42 +676,116 @@ private:
   void execute_until_timestamp(const pNode n, const std::uint64_t timestamp, const std::size_t tid, const std::size_t index = 0) {
     pOp a;
     while (true) {
-      a = hp_op.protectPtr(index, n->ops.peek(tid), tid);
-      if (a != n->ops.peek(tid)) 
-        continue;
-
+      a = n->ops.peek_protected(hp_op, index, tid);
       if (a == nullptr) break;
       if (a->timestamp > timestamp) break;
 
+      //child an update has to be pushed to, as it was logged by its incremental rebuild
+      pNode route = nullptr;
       if (rebuild_b) {
-        if (!rebuild_node(n, a->timestamp, tid))
+        if (!rebuild_node(n, a, route, tid))
           continue;
       }
 
-      if (a->type == OperationType::kInsert) {
-        do_node_insert(a, n, tid);
-      } else if (a->type == OperationType::kRemove) {
-        do_node_remove(a, n, tid);
-      } else if (a->type == OperationType::kLookup) {
-        do_node_lookup(a, n, tid);
-      } else if (a->type == OperationType::kRangeCount) {
-        do_node_rangecount(a, n, tid);
-      }
+      dispatch(a, [&]<OperationType type>(const OpOf<type> op) {
+        if (n->block != nullptr && do_block_op<type>(op, n, tid))
+          return;
+        if constexpr (type == OperationType::kInsert)
+          do_node_insert(op, n, tid, route);
+        else if constexpr (type == OperationType::kRemove)
+          do_node_remove(op, n, tid, route);
+        else if constexpr (type == OperationType::kLookup)
+          do_node_lookup(op, n, tid);
+        else
+          do_node_rangecount(op, n, tid);
+      });
 
       hp_op.clearOne(index, tid);
     }
   }
 
+  /**
+   * Calls f.template operator()<type>(op) with the type of op, where range counts are passed as RangeOperation
+   * The execute loops branch on the type once here, everything that is specific to a type is resolved at compile time
+   */
+  template <class F>
+  static void dispatch(const pOp op, F&& f) {
+    switch (op->type) {
+      case OperationType::kInsert:
+        f.template operator()<OperationType::kInsert>(op);
+        break;
+      case OperationType::kRemove:
+        f.template operator()<OperationType::kRemove>(op);
+        break;
+      case OperationType::kLookup:
+        f.template operator()<OperationType::kLookup>(op);
+        break;
+      case OperationType::kRangeCount:
+        f.template operator()<OperationType::kRangeCount>(static_cast<pRangeOp>(op));
+        break;
+    }
+  }
+
+  /**
+   * Completes op at the root if the announced operation directly before or after it in timestamp order makes its result known
+   * No other operation lies between the two, so op is still linearized at its timestamp:
+   *  - a lookup directly after an insert (remove) of the same value succeeds (fails),
+   *    directly after a lookup of the same value that was completed at the root it takes over its result
+   *  - a remove directly followed by an insert of the same value does not change the tree, the insert succeeds in any case
+   * Helpers that do not find the neighbour (anymore) pass op down as usual, which gives the same result
+   * Returns true if op was completed and only has to be popped
+   * op needs to be protected by hp
+   */
+  bool eliminate_at_root(const pOp op, const std::size_t tid) {
+    if (max_threads_ == 1 || (op->type != OperationType::kLookup && op->type != OperationType::kRemove))
+      return false;
+    //operations without a timestamp yet have timestamp 0
+    const std::uint64_t neighbour_timestamp = op->type == OperationType::kLookup ? op->timestamp - 1 : op->timestamp + 1;
+    if (neighbour_timestamp == 0)
+      return false;
+    for (std::size_t i = 0; i < max_threads_; ++i) {
+      //the owner stops announcing its operation before it retires it, so it can be accessed if it is still announced
+      pOp other = hp_op.protectPtr(1, ops_[i].load(), tid);
+      if (other == nullptr || other != ops_[i].load() || other->timestamp != neighbour_timestamp)
+        continue;
+
+      bool done = false;
+      if (other->value == op->value) {
+        if (op->type == OperationType::kRemove) {
+          if (other->type == OperationType::kInsert) {
+            other->success.store(true);
+            done = true;
+          }
+        } else if (other->type == OperationType::kInsert || other->type == OperationType::kRemove) {
+          if (other->type == OperationType::kInsert)
+            op->success.store(true);
+          done = true;
+        } else if (other->type == OperationType::kLookup && other->done_at_root) {
+          if (other->success)
+            op->success.store(true);
+          done = true;
+        }
+      }
+      hp_op.clearOne(1, tid);
+      if (done)
+        op->done_at_root.store(true);
+      //timestamps are unique, so there is no other candidate
+      return done;
+    }
+    hp_op.clearOne(1, tid);
+    return false;
+  }
+
   /**
    * Execute an insert action in the (fake) root
    * op needs to be protected by hp
    */
-  void do_root_insert(const pOp op, const std::size_t tid) {
-    pNode child = fake_root_child.load();
+  void do_root_insert(const pOp op, const std::size_t tid, const pNode route = nullptr) {
+    pNode child = route != nullptr ? route : fake_root_child.load();
     if (child == nullptr) {
       // std::cout << "a " << op->value << " r " << tid << "\n"; 
       NodeState new_state(op->timestamp, 1, 0);
-      pNode new_node = new Node<T>(max_threads_, 1, op->value, new_state);
+      pNode new_node = new Node<T, MaxThreads>(max_threads_, options_.timestamp_source, 1, op->value, new_state);
       if (!fake_root_child.compare_exchange_strong(child, new_node)) {
         delete new_node;
       } else {
@@ -370,15 +804,15 @@ private:
           return;
         }
 
-        if (curr_state.get_active()) {
-          op->split.store(op->value);            
-        } else {
+        if (!curr_state.get_active()) {
           NodeState new_state(op->timestamp, curr_state.all_children, curr_state.changes, true);
 
           if (child->state.compare_exchange_strong(curr_state, new_state)) {
             op->success.store(true);
           }
         }
+        if (!log_late_update(op, child))
+          return;
       } else {
         //node value does not match
         //push operation to child
@@ -388,6 +822,8 @@ private:
           
           child->state.compare_exchange_strong(curr_state, new_state);
         }
+        if (!log_late_update(op, child))
+          return;
         child->ops.push_if(op, tid);
       }
     }
@@ -407,6 +843,7 @@ private:
       if (child->value == op->value) {
         if (curr_state.get_active() && curr_state.get_last_timestamp() < op->timestamp)
           op->success.store(true);
+        op->done_at_root.store(true);
       } else {
         op->to_visit.push(child, 0, tid);
       }
@@ -419,6 +856,8 @@ private:
 
       if (child->value != op->value)
         child->ops.push_if(op, tid);
+    } else {
+      op->done_at_root.store(true);
     }
     fake_root_q.pop_if(op->timestamp, tid);
   }
@@ -428,8 +867,8 @@ private:
    * Nodes are only marked as inactive and will be removed when the subtree is rebuild
    * op needs to be protected by hp
    */
-  void do_root_remove(const pOp op, const std::size_t tid) {
-    pNode child = fake_root_child.load();
+  void do_root_remove(const pOp op, const std::size_t tid, const pNode route = nullptr) {
+    pNode child = route != nullptr ? route : fake_root_child.load();
 
     if (child != nullptr) {
       NodeState curr_state = child->state.load();
@@ -442,6 +881,8 @@ private:
         
         child->state.compare_exchange_strong(curr_state, new_state);
       }
+      if (!log_late_update(op, child))
+        return;
 
       if (child->value != op->value) 
         child->ops.push_if(op, tid);
@@ -454,7 +895,7 @@ private:
    * Execute a range_count action in the (fake) root
    * op needs to be protected by hp
    */
-  void do_root_rangecount(const pOp op, const std::size_t tid) {
+  void do_root_rangecount(const pRangeOp op, const std::size_t tid) {
     pNode child = fake_root_child.load();
     if (child != nullptr) {
         if (child->value >= op->value && child->value <= op->value2) {
@@ -469,19 +910,73 @@ private:
     fake_root_q.pop_if(op->timestamp, tid);
   }
 
+  /**
+   * Execute the part of op that concerns the block of the fat leaf n
+   * Inserts, removes and lookups of a value of the block are completed here and true is returned,
+   * range counts add the active values of the block in their range and continue like in other nodes
+   * op needs to be protected by hp
+   */
+  template <OperationType type>
+  bool do_block_op(const OpOf<type> op, const pNode n, const std::size_t tid) {
+    LeafBlock<T>* block = n->block;
+    BlockState curr_state = block->state.load();
+    if constexpr (type == OperationType::kRangeCount) {
+      //an update newer than op changed the block already, so op was done here by another thread
+      if (curr_state.timestamp < op->timestamp) {
+        std::uint32_t count = std::popcount(block->range_mask(op->value, op->value2) & curr_state.active);
+        if (count > 0)
+          op->to_visit.push(block_entry(block), count, tid);
+      }
+      return false;
+    }
+
+    int index = block->find(op->value);
+    if (index < 0)
+      return false;
+    const std::uint64_t bit = std::uint64_t{1} << index;
+
+    if constexpr (type == OperationType::kLookup) {
+      if (curr_state.timestamp < op->timestamp && (curr_state.active & bit) != 0)
+        op->success.store(true);
+    } else {
+      constexpr bool insert = type == OperationType::kInsert;
+      while (curr_state.timestamp < op->timestamp) {
+        BlockState new_state{op->timestamp, insert ? curr_state.active | bit : curr_state.active & ~bit};
+        if (block->state.compare_exchange_strong(curr_state, new_state)) {
+          if (insert && (curr_state.active & bit) == 0)
+            op->success.store(true);
+          break;
+        }
+      }
+    }
+    n->ops.pop_if(op->timestamp, tid);
+    return true;
+  }
+
+  /**
+   * The entry of a block in the to_visit queue of a range count, tagged with the lowest bit so it can not be mistaken for a node
+   */
+  static pNode block_entry(LeafBlock<T>* block) {
+    return reinterpret_cast<pNode>(reinterpret_cast<std::uintptr_t>(block) | 1);
+  }
+
+  static bool is_block_entry(const pNode n) {
+    return (reinterpret_cast<std::uintptr_t>(n) & 1) != 0;
+  }
+
   /**
    * Execute an insert action in n
    * op needs to be protected by hp
    */
-  void do_node_insert(const pOp op, const pNode n, const std::size_t tid) {
+  void do_node_insert(const pOp op, const pNode n, const std::size_t tid, const pNode route = nullptr) {
     pNode child;
     // op->value != n->value because we made it to this node
     if (op->value < n->value) {
-      child = n->left_child.load();
+      child = route != nullptr ? route : n->left_child.load();
       if (child == nullptr) {
         // std::cout << "a " << op->value << " " << n->value << " " << tid << "\n"; 
         NodeState new_state(op->timestamp, 1, 0);
-        pNode new_node = new Node<T>(max_threads_, 1, op->value, new_state);
+        pNode new_node = new Node<T, MaxThreads>(max_threads_, options_.timestamp_source, 1, op->value, new_state);
         if (!n->left_child.compare_exchange_strong(child, new_node)) {
           delete new_node;
         } else {
@@ -493,11 +988,11 @@ private:
           return;
       }
     } else if (op->value > n->value) {
-      child = n->right_child.load();
+      child = route != nullptr ? route : n->right_child.load();
       if (child == nullptr) {
         // std::cout << "a " << op->value << " " << n->value << " " << tid << "\n"; 
         NodeState new_state(op->timestamp, 1, 0);
-        pNode new_node = new Node<T>(max_threads_, 1, op->value, new_state);
+        pNode new_node = new Node<T, MaxThreads>(max_threads_, options_.timestamp_source, 1, op->value, new_state);
         if (!n->right_child.compare_exchange_strong(child, new_node)) {
           delete new_node;
         } else {
@@ -530,15 +1025,15 @@ private:
       if (curr_state.get_last_timestamp() >= op->timestamp) 
         return true;
 
-      if (curr_state.get_active()) {
-        op->split.store(op->value);            
-      } else {
+      if (!curr_state.get_active()) {
         NodeState new_state(op->timestamp, curr_state.all_children, curr_state.changes, true);
 
         if (child->state.compare_exchange_strong(curr_state, new_state)) {
           op->success.store(true);
         }
       }
+      if (!log_late_update(op, child))
+        return false;
     } else {
       //node value does not match
       //push operation to child
@@ -548,6 +1043,8 @@ private:
         
         child->state.compare_exchange_strong(curr_state, new_state);
       }
+      if (!log_late_update(op, child))
+        return false;
 
       child->ops.push_if(op, tid);
       return true;
@@ -591,10 +1088,12 @@ private:
    * Nodes are only marked as inactive and will be removed when the subtree is rebuild
    * op needs to be protected by hp
    */
-  void do_node_remove(const pOp op, const pNode n, const std::size_t tid) {
+  void do_node_remove(const pOp op, const pNode n, const std::size_t tid, const pNode route = nullptr) {
     pNode child = n->right_child.load();
     if (op->value < n->value)
       child = n->left_child.load();
+    if (route != nullptr)
+      child = route;
 
     if (child != nullptr) {
       NodeState curr_state = child->state.load();
@@ -607,6 +1106,8 @@ private:
 
         child->state.compare_exchange_strong(curr_state, new_state);
       }
+      if (!log_late_update(op, child))
+        return;
 
       if (child->value != op->value) 
         child->ops.push_if(op, tid);
@@ -619,7 +1120,7 @@ private:
    * Execute a range_count action in n
    * op needs to be protected by hp
    */
-  void do_node_rangecount(const pOp op, const pNode n, const std::size_t tid) {
+  void do_node_rangecount(const pRangeOp op, const pNode n, const std::size_t tid) {
     if (op->split == T{}) {
       //This means n is not part of the result
       pNode child = n->left_child.load();
@@ -685,7 +1186,7 @@ private:
    * lower indicates if the remaning results should be added to op->lower_value (true) or op->upper_value (false)
    */
   template <class Compare = std::less<>>
-  void handle_split_query(const pOp op, const pNode n, const pNode inner_child, const pNode outer_child, const T comp_value, const std::size_t tid, bool lower, Compare&& comp = {}) {
+  void handle_split_query(const pRangeOp op, const pNode n, const pNode inner_child, const pNode outer_child, const T comp_value, const std::size_t tid, bool lower, Compare&& comp = {}) {
     if (comp(n->value, comp_value)) {
       //whole inner child + push to outer child
       std::uint32_t inner_child_size = 0;
@@ -729,72 +1230,313 @@ private:
    * Rebuils the child of the (fake) root if neccessary
    * Returns false if the operation in the execute_until_timestamp_root function needs to be reloaded (bc this functions accessed other operations)
    * Returns true if operations does not need to be reloaded
+   * a needs to be protected by hp
    */
-  bool rebuild_root(const std::uint64_t timestamp, const std::size_t tid) {
-    pNode child = fake_root_child.load();
+  bool rebuild_root(const pOp a, pNode& route, const std::size_t tid) {
+    LogEntry update{a->type == OperationType::kInsert, a->value, a->timestamp, nullptr};
+    const bool is_update = a->type == OperationType::kInsert || a->type == OperationType::kRemove;
+
+    bool worked = false;
+    if (rebuild_link(fake_root_child, a->timestamp, is_update ? &update : nullptr, route, worked, tid))
+      return false;
+    //the steps of an incremental rebuild overwrote the hazard pointer of a, it is still valid if a was not popped
+    //a could have been freed and its memory reused by a newer operation at the front, which has a different timestamp
+    return !worked || (fake_root_q.is_front(hp_op.protectPtr(0, a, tid), tid) && a->timestamp == update.timestamp);
+  }
+
+  /**
+   * Rebuils the childdren of the n if neccessary
+   * Returns false if the operation in the execute_until_timestamp function needs to be reloaded (bc this functions accessed other operations)
+   * Returns true if operations does not need to be reloaded
+   * a needs to be protected by hp
+   */
+  bool rebuild_node(const pNode n, const pOp a, pNode& route, const std::size_t tid) {
+    LogEntry update{a->type == OperationType::kInsert, a->value, a->timestamp, nullptr};
+    const bool is_update = a->type == OperationType::kInsert || a->type == OperationType::kRemove;
+
+    bool worked = false;
+    bool need_to_reload = rebuild_link(n->left_child, update.timestamp, is_update && update.value < n->value ? &update : nullptr, route, worked, tid);
+    need_to_reload |= rebuild_link(n->right_child, update.timestamp, is_update && n->value < update.value ? &update : nullptr, route, worked, tid);
+    if (need_to_reload)
+      return false;
+    //same as in rebuild_root, route belongs to the operation with the timestamp of update
+    return !worked || (n->ops.is_front(hp_op.protectPtr(0, a, tid), tid) && a->timestamp == update.timestamp);
+  }
+
+  /**
+   * Rebuilds the subtree link points to if the rebuild policy asks for it and replaces it with the new subtree
+   * update is the operation that passes link, if it is an insert or remove that goes into the subtree
+   * route is set to the old subtree if update was logged by its incremental rebuild, so update has to go there
+   * worked is set if an incremental rebuild accessed other operations, without relinking the subtree
+   * Returns true if the subtree was rebuilt (by this or another thread)
+   */
+  bool rebuild_link(boost::atomic<pNode>& link, const std::uint64_t timestamp, const LogEntry* update, pNode& route, bool& worked, const std::size_t tid) {
+    pNode child = link.load();
     if (child == nullptr)
-      return true;
+      return false;
+    const bool incremental = options_.rebuild_mode != RebuildMode::kInline;
+    if (incremental) {
+      RebuildDescriptor<T, MaxThreads>* desc = child->rebuild.load();
+      if (desc != nullptr && !desc->abandoned.load())
+        return advance_incremental_rebuild(link, child, desc, update, route, worked, tid);
+    }
+
     NodeState curr_state = child->state.load();
-    if (curr_state.changes > child->init_size/2 && (curr_state.all_children > 5 || child->init_size > 5)) {
-      std::pair<pNode, bool> new_node_b = rebuild(child, timestamp, tid);
-      if (!new_node_b.second)
+    if (!rebuild_policy_.should_rebuild(child->init_size, curr_state))
+      return false;
+    const auto start = std::chrono::steady_clock::now();
+
+    if (child->init_size >= options_.cooperative_rebuild_min_size && options_.rebuild_mode == RebuildMode::kBackground) {
+      //only one thread makes a request, the old subtree is used until a worker is done
+      RebuildDescriptor<T, MaxThreads>* desc = get_rebuild_descriptor(child, timestamp, tid);
+      if (desc == nullptr)
         return false;
-      if (!fake_root_child.compare_exchange_strong(child, new_node_b.first)) {
-        delete_tree(new_node_b.first);
+      if (desc->confirmed.load() && !desc->requested.exchange(true))
+        rebuild_requests_.push(child->value, tid);
+      return advance_incremental_rebuild(link, child, desc, update, route, worked, tid);
+    } else if (child->init_size >= options_.cooperative_rebuild_min_size && incremental) {
+      RebuildDescriptor<T, MaxThreads>* desc = get_rebuild_descriptor(child, timestamp, tid);
+      if (desc == nullptr)
         return false;
-      } else {
-        to_be_deleted_.push({set_mask_.load(), child}, tid);
-        to_be_deleted_num_.fetch_add(1);
+      worked = true;
+      return advance_incremental_rebuild(link, child, desc, update, route, worked, tid);
+    } else if (child->init_size >= options_.cooperative_rebuild_min_size && max_threads_ > 1) {
+      //all threads get the same new subtree, so there is nothing to clean up if another thread linked it first
+      RebuildDescriptor<T, MaxThreads>* desc = get_rebuild_descriptor(child, timestamp, tid);
+      if (desc == nullptr)
         return false;
+      rebuild_steps(child, desc, std::numeric_limits<std::size_t>::max(), tid);
+      if (desc->abandoned.load() || !link.compare_exchange_strong(child, desc->result.load()))
+        return true;
+      desc->linked.store(true);
+    } else {
+      std::pair<pNode, bool> new_node_b = rebuild(child, timestamp, tid);
+      //same as in get_rebuild_descriptor, the subtree of a lagging thread misses the newer operations
+      //the rebuild accessed other operations, so the caller has to reload its operation anyway
+      if (child->state.load().get_last_timestamp() >= timestamp) {
+        delete_tree(new_node_b.first);
+        return true;
+      }
+      if (!link.compare_exchange_strong(child, new_node_b.first)) {
+        delete_tree(new_node_b.first);
+        return true;
       }
     }
+    //incremental rebuilds are spread over many operations, so only the cost of inline rebuilds is reported
+    rebuild_policy_.record_rebuild(curr_state.all_children, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+    to_be_deleted_.push({set_mask_.load(), child}, tid);
+    to_be_deleted_num_.fetch_add(1, boost::memory_order_relaxed);
     return true;
   }
 
   /**
-   * Rebuils the childdren of the n if neccessary
-   * Returns false if the operation in the execute_until_timestamp function needs to be reloaded (bc this functions accessed other operations)
-   * Returns true if operations does not need to be reloaded
+   * Log update and do options_.incremental_budget chunks of the incremental rebuild of child (none if a background worker does the rebuild)
+   * The new subtree is linked once it is complete and confirmed, but only by an update that was not logged,
+   * as every logged update has to reach the old subtree and gets its result there
+   * Returns true if the new subtree was linked
    */
-  bool rebuild_node(const pNode n, const std::uint64_t timestamp, const std::size_t tid) {
-    bool need_to_reload = false;
-
-    pNode child = n->left_child.load();
-    if (child != nullptr) {
-      NodeState curr_state = child->state.load();
-      if (curr_state.changes > child->init_size/2 && (curr_state.all_children > 5 || child->init_size > 5)) {
-        std::pair<pNode, bool> new_node_b = rebuild(child, timestamp, tid);
-        if (!new_node_b.second)
-          return false;
-        if (!n->left_child.compare_exchange_strong(child, new_node_b.first)) {
-          delete_tree(new_node_b.first);
-          return false;
-        } else {
-          to_be_deleted_.push({set_mask_.load(), child}, tid);
-          to_be_deleted_num_.fetch_add(1);
-          need_to_reload = true;
+  bool advance_incremental_rebuild(boost::atomic<pNode>& link, const pNode child, RebuildDescriptor<T, MaxThreads>* desc, const LogEntry* update, pNode& route, bool& worked, const std::size_t tid) {
+    if (!desc->finished.load() || !desc->confirmed.load()) {
+      if (update != nullptr && update->timestamp >= desc->timestamp) {
+        if (!log_update(desc, *update)) {
+          install_incremental_rebuild(link, child, desc, tid);
+          return true;
         }
+        route = child;
       }
+      if (options_.rebuild_mode == RebuildMode::kIncremental) {
+        rebuild_steps(child, desc, options_.incremental_budget, tid);
+        worked = true;
+      }
+      return false;
     }
+    if (update != nullptr && is_logged(desc, *update)) {
+      route = child;
+      return false;
+    }
+    install_incremental_rebuild(link, child, desc, tid);
+    return true;
+  }
 
-    child = n->right_child.load();
-    if (child != nullptr) {
-      NodeState curr_state = child->state.load();
-      if (curr_state.changes > child->init_size/2 && (curr_state.all_children > 5 || child->init_size > 5)) {
-        std::pair<pNode, bool> new_node_b = rebuild(child, timestamp, tid);
-        if (!new_node_b.second)
-          return false;
-        if (!n->right_child.compare_exchange_strong(child, new_node_b.first)){
-          delete_tree(new_node_b.first);
-          return false;
-        } else {
-          to_be_deleted_.push({set_mask_.load(), child}, tid);
-          to_be_deleted_num_.fetch_add(1);
-          need_to_reload = true;
-        }
+  /**
+   * Returns true if update is part of the log of desc
+   */
+  bool is_logged(RebuildDescriptor<T, MaxThreads>* desc, const LogEntry& update) {
+    const LogEntry* head = desc->log.load();
+    if (head != nullptr && head->timestamp == RebuildDescriptor<T, MaxThreads>::kSealed)
+      head = head->next;
+    //updates pass the parent in timestamp order, so a newer entry means update was logged already
+    return update.timestamp >= desc->timestamp && head != nullptr && head->timestamp >= update.timestamp;
+  }
+
+  /**
+   * Append update to the log of desc, if it is not part of it yet
+   * Returns false if the log is sealed without update, then update has to go to the new subtree
+   */
+  bool log_update(RebuildDescriptor<T, MaxThreads>* desc, const LogEntry& update) {
+    LogEntry* entry = nullptr;
+    LogEntry* head = desc->log.load();
+    while (true) {
+      if (is_logged(desc, update)) {
+        delete entry;
+        return true;
+      }
+      if (head != nullptr && head->timestamp == RebuildDescriptor<T, MaxThreads>::kSealed) {
+        delete entry;
+        return false;
+      }
+      if (entry == nullptr)
+        entry = new LogEntry(update);
+      entry->next = head;
+      if (desc->log.compare_exchange_strong(head, entry))
+        return true;
+    }
+  }
+
+  /**
+   * Log op in the incremental rebuild of child, in case it was published after rebuild_link looked for it
+   * Has to be called after op wrote the state of child and before op is pushed to child
+   * Returns false if the new subtree was linked without op, then op has to be reloaded to reach the new subtree
+   */
+  bool log_late_update(const pOp op, const pNode child) {
+    if (!rebuild_b || options_.rebuild_mode == RebuildMode::kInline)
+      return true;
+    //seq_cst: with the state CAS of op before it, this pairs with the descriptor CAS and state load in get_rebuild_descriptor,
+    //so either this sees the descriptor or get_rebuild_descriptor sees the timestamp of op and abandons it
+    RebuildDescriptor<T, MaxThreads>* desc = child->rebuild.load();
+    if (desc == nullptr || desc->abandoned.load() || op->timestamp < desc->timestamp)
+      return true;
+    return log_update(desc, LogEntry{op->type == OperationType::kInsert, op->value, op->timestamp, nullptr});
+  }
+
+  /**
+   * Seal the log of desc, finish the new subtree, replay the log on it and link it in place of child
+   */
+  void install_incremental_rebuild(boost::atomic<pNode>& link, pNode child, RebuildDescriptor<T, MaxThreads>* desc, const std::size_t tid) {
+    LogEntry* head = desc->log.load();
+    LogEntry* seal = nullptr;
+    while (head == nullptr || head->timestamp != RebuildDescriptor<T, MaxThreads>::kSealed) {
+      if (seal == nullptr)
+        seal = new LogEntry{false, T{}, RebuildDescriptor<T, MaxThreads>::kSealed, nullptr};
+      seal->next = head;
+      if (desc->log.compare_exchange_strong(head, seal))
+        seal = nullptr;
+    }
+    delete seal;
+
+    rebuild_steps(child, desc, std::numeric_limits<std::size_t>::max(), tid);
+    replay_log(desc);
+    if (link.compare_exchange_strong(child, desc->installed.load())) {
+      desc->linked.store(true);
+      to_be_deleted_.push({set_mask_.load(), child}, tid);
+      to_be_deleted_num_.fetch_add(1, boost::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Apply the newest logged update of every value to the new subtree of desc
+   * The new subtree is not modified, the paths to the updated values are copied, so every thread computes the same result on its own
+   */
+  void replay_log(RebuildDescriptor<T, MaxThreads>* desc) {
+    if (desc->replayed.load())
+      return;
+
+    //the log is ordered from new to old
+    std::vector<const LogEntry*> entries;
+    std::uint64_t timestamp = desc->timestamp - 1;
+    for (const LogEntry* entry = desc->log.load(); entry != nullptr; entry = entry->next) {
+      if (entry->timestamp == RebuildDescriptor<T, MaxThreads>::kSealed)
+        continue;
+      timestamp = std::max(timestamp, entry->timestamp);
+      entries.push_back(entry);
+    }
+    std::stable_sort(entries.begin(), entries.end(), [](const LogEntry* a, const LogEntry* b) { return a->value < b->value; });
+    entries.erase(std::unique(entries.begin(), entries.end(), [](const LogEntry* a, const LogEntry* b) { return a->value == b->value; }), entries.end());
+
+    std::unordered_map<pNode, pNode> copies;
+    pNode root = desc->result.load();
+    for (const LogEntry* entry : entries) {
+      root = replay_update(root, entry->value, entry->insert, timestamp, copies);
+    }
+    //logged updates that still reach the new subtree have to be ignored by it
+    if (root != nullptr && !entries.empty())
+      root = copy_node(root, timestamp, copies);
+
+    pNode expected = nullptr;
+    if (desc->installed.compare_exchange_strong(expected, root)) {
+      auto replaced = new std::vector<pNode>();
+      for (auto [original, copy] : copies) {
+        if (original != copy)
+          replaced->push_back(original);
+      }
+      desc->replaced.store(replaced);
+      desc->replayed.store(true);
+    } else {
+      for (auto [original, copy] : copies) {
+        if (original == copy)
+          delete copy;
+      }
+    }
+  }
+
+  /**
+   * Make value part of the subtree rooted at root (insert = true) or remove it, copying all nodes on the path that are not copies yet
+   * Returns the new root
+   */
+  pNode replay_update(pNode root, const T value, const bool insert, const std::uint64_t timestamp, std::unordered_map<pNode, pNode>& copies) {
+    pNode n = root;
+    while (n != nullptr && n->value != value) {
+      n = value < n->value ? n->left_child.load() : n->right_child.load();
+    }
+    bool present = n != nullptr && n->state.load().get_active();
+    if (present == insert)
+      return root;
+
+    if (root == nullptr) {
+      pNode leaf = new Node<T, MaxThreads>(max_threads_, options_.timestamp_source, 1, value, NodeState(timestamp, 1, 0));
+      copies[leaf] = leaf;
+      return leaf;
+    }
+    root = copy_node(root, timestamp, copies);
+    n = root;
+    while (true) {
+      NodeState curr_state = n->state.load();
+      std::uint32_t all_children = insert ? curr_state.all_children + 1 : curr_state.all_children - 1;
+      if (n->value == value) {
+        n->state.store(NodeState(timestamp, all_children, curr_state.changes + 1, insert));
+        break;
+      }
+      n->state.store(NodeState(timestamp, all_children, curr_state.changes + 1, curr_state.get_active()));
+
+      boost::atomic<pNode>& child_link = value < n->value ? n->left_child : n->right_child;
+      pNode child = child_link.load();
+      if (child == nullptr) {
+        pNode leaf = new Node<T, MaxThreads>(max_threads_, options_.timestamp_source, 1, value, NodeState(timestamp, 1, 0));
+        copies[leaf] = leaf;
+        child_link.store(leaf);
+        break;
       }
+      child = copy_node(child, timestamp, copies);
+      child_link.store(child);
+      n = child;
     }
-    return !need_to_reload;
+    return root;
+  }
+
+  /**
+   * Returns a copy of n with the given last timestamp, or n itself if it is a copy already
+   */
+  pNode copy_node(const pNode n, const std::uint64_t timestamp, std::unordered_map<pNode, pNode>& copies) {
+    auto it = copies.find(n);
+    if (it != copies.end())
+      return it->second;
+    NodeState curr_state = n->state.load();
+    pNode copy = new Node<T, MaxThreads>(max_threads_, options_.timestamp_source, n->init_size, n->value, NodeState(timestamp, curr_state.all_children, curr_state.changes, curr_state.get_active()));
+    copy->left_child.store(n->left_child.load(), boost::memory_order_relaxed);
+    copy->right_child.store(n->right_child.load(), boost::memory_order_relaxed);
+    copies[n] = copy;
+    copies[copy] = copy;
+    return copy;
   }
 
   /**
@@ -805,90 +1547,691 @@ private:
    */
   std::pair<pNode, bool> rebuild(const pNode n, const std::uint64_t timestamp, const std::size_t tid) {
     NodeState curr_state = n->state.load();
-    
+
     std::vector<T> values;
     values.reserve(n->init_size + curr_state.changes);
-    std::queue<pNode> to_be_done;
-    to_be_done.push(n);
+    collect_values(n, timestamp, tid, values);
+
+    if (values.size() == 0) {
+      return {nullptr, true};
+    }
+    return {build_tree(values, 0, values.size()-1, timestamp, &node_pools_[tid]), true};
+  }
 
+  /**
+   * Finish all operations until timestamp in the subtree rooted at n and append the values of all active nodes to values
+   * The values are collected in-order, so they are sorted already
+   */
+  void collect_values(const pNode n, const std::uint64_t timestamp, const std::size_t tid, std::vector<T>& values) {
     //do to traversals of the subtree twice like it is porposed in the paper
     //finish all operations
-    while (!to_be_done.empty()) {
-      auto a = to_be_done.front();
-      to_be_done.pop();
+    finish_subtree(n, timestamp, tid);
+
+    //collect all active nodes
+    std::vector<pNode> stack;
+    pNode a = n;
+    while (a != nullptr || !stack.empty()) {
+      if (a != nullptr && a->block != nullptr) {
+        //the block of a fat leaf has to be merged with the values below it
+        append_fat_leaf(a, nullptr, nullptr, values);
+        a = nullptr;
+      } else if (a != nullptr) {
+        stack.push_back(a);
+        a = a->left_child.load();
+      } else {
+        a = stack.back();
+        stack.pop_back();
+
+        NodeState curr_state = a->state.load();
+
+        if (curr_state.get_active())
+          values.emplace_back(a->value);
+
+        a = a->right_child.load();
+      }
+    }
+  }
+
+  /**
+   * Finish all operations until timestamp in the subtree rooted at n
+   */
+  void finish_subtree(const pNode n, const std::uint64_t timestamp, const std::size_t tid) {
+    //executing the operations of a node can rebuild a subtree below it, which finishes that subtree with the same stack
+    std::vector<pNode>& to_be_done = scratch_[tid].subtree_stack;
+    const std::size_t base = to_be_done.size();
+    to_be_done.push_back(n);
+    //parents are still finished before their children
+    while (to_be_done.size() > base) {
+      pNode a = to_be_done.back();
+      to_be_done.pop_back();
 
       execute_until_timestamp(a, timestamp, tid);
 
       pNode child = a->left_child.load();
       if (child != nullptr)
-        to_be_done.push(child);
+        to_be_done.push_back(child);
       child = a->right_child.load();
       if (child != nullptr)
-        to_be_done.push(child);
+        to_be_done.push_back(child);
     }
-    //collect all active nodes
+  }
+
+  /**
+   * Append the active values in [lower, upper) of the subtree of the fat leaf n in ascending order to values, nullptr stands for an open bound
+   * The values below n were inserted after the block was built, so both are collected separately and merged
+   * The subtree can contain further fat leaves, if a subtree of the inserted values was rebuilt
+   * All operations in the subtree have to be finished already
+   */
+  static void append_fat_leaf(const pNode n, const T* lower, const T* upper, std::vector<T>& values) {
+    auto in_range = [lower, upper](const T& value) {
+      return (lower == nullptr || !(value < *lower)) && (upper == nullptr || value < *upper);
+    };
+    const std::size_t begin = values.size();
+    std::vector<pNode> stack;
+    pNode a = n;
+    while (a != nullptr || !stack.empty()) {
+      if (a != nullptr && a != n && a->block != nullptr) {
+        append_fat_leaf(a, lower, upper, values);
+        a = nullptr;
+      } else if (a != nullptr) {
+        stack.push_back(a);
+        a = a->left_child.load();
+      } else {
+        a = stack.back();
+        stack.pop_back();
+        if (a->state.load().get_active() && in_range(a->value))
+          values.push_back(a->value);
+        a = a->right_child.load();
+      }
+    }
+    const std::size_t middle = values.size();
+    const LeafBlock<T>* block = n->block;
+    const std::uint64_t active = block->state.load().active;
+    for (std::size_t i = 0; i < block->size; ++i) {
+      if ((active >> i & 1) != 0 && in_range(block->keys[i]))
+        values.push_back(block->keys[i]);
+    }
+    std::inplace_merge(values.begin() + begin, values.begin() + middle, values.end());
+  }
+
+  /**
+   * Returns the descriptor of the rebuild of the subtree rooted at n, creating it if necessary
+   * Returns nullptr if there is none and the operation with timestamp already passed n, or if the new descriptor had to be abandoned
+   */
+  RebuildDescriptor<T, MaxThreads>* get_rebuild_descriptor(const pNode n, const std::uint64_t timestamp, const std::size_t tid) {
+    RebuildDescriptor<T, MaxThreads>* desc = n->rebuild.load();
+    if (desc != nullptr && !desc->abandoned.load())
+      return desc;
+    //a lagging thread must not start the rebuild, operations newer than timestamp could be in the subtree already
+    if (n->state.load().get_last_timestamp() >= timestamp)
+      return nullptr;
+    RebuildDescriptor<T, MaxThreads>* new_desc = create_rebuild_descriptor(n, timestamp, tid);
+    new_desc->previous = desc;
+    if (!n->rebuild.compare_exchange_strong(desc, new_desc)) {
+      new_desc->previous = nullptr;
+      delete new_desc;
+      return desc != nullptr && !desc->abandoned.load() ? desc : nullptr;
+    }
+    //an update could have passed the parent between the check above and publishing the descriptor without seeing it,
+    //updates write the state of n before they look for the descriptor again (see log_late_update), so one of both sees the other
+    if (n->state.load().get_last_timestamp() >= timestamp) {
+      new_desc->abandoned.store(true);
+      return nullptr;
+    }
+    new_desc->confirmed.store(true);
+    return new_desc;
+  }
+
+  /**
+   * Do up to budget chunks of the rebuild, see RebuildDescriptor
+   * Chunks nobody started yet are claimed first, afterwards the calling thread helps with the ones that are not finished,
+   * so the rebuild takes about n->init_size/threads steps if enough threads help
+   * Returns true if the new subtree is complete
+   */
+  bool rebuild_steps(const pNode n, RebuildDescriptor<T, MaxThreads>* desc, std::size_t budget, const std::size_t tid) {
+    const std::size_t num_chunks = desc->num_chunks();
+    while (budget > 0 && !desc->finished.load()) {
+      std::size_t i = desc->next_chunk.load(boost::memory_order_relaxed) < num_chunks ? desc->next_chunk.fetch_add(1, boost::memory_order_relaxed) : num_chunks;
+      if (i >= num_chunks) {
+        i = 0;
+        while (i < num_chunks && desc->collected[i].load() != nullptr)
+          ++i;
+      }
+      if (i < num_chunks) {
+        collect_chunk(desc, n, i, tid);
+        --budget;
+        continue;
+      }
+
+      auto plan = get_build_plan(desc);
+      const std::size_t num_tasks = plan->tasks.size();
+      i = plan->next_task.load(boost::memory_order_relaxed) < num_tasks ? plan->next_task.fetch_add(1, boost::memory_order_relaxed) : num_tasks;
+      if (i >= num_tasks) {
+        i = 0;
+        while (i < num_tasks && plan->built[i].load() != nullptr)
+          ++i;
+      }
+      if (i < num_tasks) {
+        build_chunk(desc, plan, i, tid);
+        --budget;
+        continue;
+      }
+
+      finish_cooperative_rebuild(desc, plan);
+    }
+    return desc->finished.load();
+  }
+
+  /**
+   * Split the values of the subtree rooted at n into key ranges for a cooperative rebuild
+   * The bounds are the values of the top levels of the subtree, so the ranges are about equally large
+   */
+  RebuildDescriptor<T, MaxThreads>* create_rebuild_descriptor(const pNode n, const std::uint64_t timestamp, const std::size_t /*tid*/) {
+    auto desc = new RebuildDescriptor<T, MaxThreads>(timestamp);
+    //incremental rebuilds need small chunks, as every operation only does a few of them
+    std::size_t target_chunks = 4 * max_threads_;
+    if (options_.rebuild_mode == RebuildMode::kIncremental)
+      target_chunks = std::max(target_chunks, static_cast<std::size_t>(n->init_size) / std::max<std::size_t>(options_.incremental_chunk_size, 1));
+
+    std::queue<pNode> to_be_done;
     to_be_done.push(n);
-    while (!to_be_done.empty()) {
-      auto a = to_be_done.front();
+    while (!to_be_done.empty() && desc->bounds.size() + 1 < target_chunks) {
+      pNode a = to_be_done.front();
       to_be_done.pop();
+      desc->bounds.push_back(a->value);
+      if (a->left_child.load() != nullptr)
+        to_be_done.push(a->left_child.load());
+      if (a->right_child.load() != nullptr)
+        to_be_done.push(a->right_child.load());
+    }
+    std::sort(desc->bounds.begin(), desc->bounds.end());
+    desc->collected = std::make_unique<boost::atomic<std::vector<T>*>[]>(desc->num_chunks());
+    return desc;
+  }
 
-      curr_state = a->state.load();
+  /**
+   * Finish and collect the values of chunk i, if no other thread did it yet
+   * The chunk is looked up from the current root of the subtree, as its nodes could have been rebuilt since the descriptor was created
+   */
+  void collect_chunk(RebuildDescriptor<T, MaxThreads>* desc, const pNode n, const std::size_t i, const std::size_t tid) {
+    if (desc->collected[i].load() != nullptr)
+      return;
+    auto values = new std::vector<T>();
+    const T* lower = i > 0 ? &desc->bounds[i-1] : nullptr;
+    const T* upper = i < desc->bounds.size() ? &desc->bounds[i] : nullptr;
+    collect_range(n, lower, upper, desc->timestamp, tid, *values);
+    std::vector<T>* expected = nullptr;
+    if (!desc->collected[i].compare_exchange_strong(expected, values))
+      delete values;
+  }
 
-      if (curr_state.get_active())
-        values.emplace_back(a->value);
+  /**
+   * Finish all operations until timestamp on the paths to the values in [lower, upper) of the subtree rooted at n
+   * and append the active ones in ascending order to values, nullptr stands for an open bound
+   */
+  void collect_range(const pNode n, const T* lower, const T* upper, const std::uint64_t timestamp, const std::size_t tid, std::vector<T>& values) {
+    //in-order traversal, the operations of a node are finished before its children are loaded
+    std::vector<std::pair<pNode, bool>> stack{{n, false}};
+    while (!stack.empty()) {
+      auto [a, expanded] = stack.back();
+      stack.pop_back();
+      if (expanded) {
+        NodeState curr_state = a->state.load();
+        if (curr_state.get_active() && (lower == nullptr || !(a->value < *lower)) && (upper == nullptr || a->value < *upper))
+          values.push_back(a->value);
+        continue;
+      }
+      if (a->block != nullptr) {
+        finish_subtree(a, timestamp, tid);
+        append_fat_leaf(a, lower, upper, values);
+        continue;
+      }
+      execute_until_timestamp(a, timestamp, tid);
+      pNode left = a->left_child.load();
+      pNode right = a->right_child.load();
+      if (right != nullptr && (upper == nullptr || a->value < *upper))
+        stack.push_back({right, false});
+      stack.push_back({a, true});
+      if (left != nullptr && (lower == nullptr || *lower < a->value))
+        stack.push_back({left, false});
+    }
+  }
 
-      pNode child = a->left_child.load();
-      if (child != nullptr)
-        to_be_done.push(child);
-      child = a->right_child.load();
-      if (child != nullptr)
-        to_be_done.push(child);
+  /**
+   * Returns the build plan of desc, creating it if necessary
+   * All chunks have to be collected
+   */
+  typename RebuildDescriptor<T, MaxThreads>::BuildPlan* get_build_plan(RebuildDescriptor<T, MaxThreads>* desc) {
+    using BuildPlan = typename RebuildDescriptor<T, MaxThreads>::BuildPlan;
+    BuildPlan* plan = desc->plan.load();
+    if (plan != nullptr)
+      return plan;
+
+    plan = new BuildPlan();
+    for (std::size_t i = 0; i < desc->num_chunks(); ++i) {
+      std::span<const T> piece(*desc->collected[i].load());
+      if (piece.empty())
+        continue;
+      plan->offsets.push_back(plan->size);
+      plan->pieces.push_back(piece);
+      plan->size += piece.size();
+    }
+    //about as many build tasks as there were collected chunks
+    plan->depth = std::bit_width(desc->num_chunks());
+    if (plan->size > 0)
+      add_build_tasks(*plan, 0, plan->size - 1, plan->depth);
+    plan->built = std::make_unique<boost::atomic<pNode>[]>(plan->tasks.size());
+
+    BuildPlan* expected = nullptr;
+    if (!desc->plan.compare_exchange_strong(expected, plan)) {
+      delete plan;
+      return expected;
+    }
+    return plan;
+  }
+
+  /**
+   * Split the values [left:right+1] (in python notation) like build_tree does and add a task for every subtree depth levels below
+   */
+  void add_build_tasks(typename RebuildDescriptor<T, MaxThreads>::BuildPlan& plan, std::size_t left, std::size_t right, std::size_t depth) {
+    if (depth == 0) {
+      plan.tasks.push_back({left, right});
+      return;
     }
+    std::size_t middle = left+((right-left)/2);
+    if (middle > left)
+      add_build_tasks(plan, left, middle-1, depth-1);
+    if (middle < right)
+      add_build_tasks(plan, middle+1, right, depth-1);
+  }
 
-    std::sort(values.begin(), values.end());
+  /**
+   * Build the subtree of task i, if no other thread did it yet
+   */
+  void build_chunk(RebuildDescriptor<T, MaxThreads>* desc, typename RebuildDescriptor<T, MaxThreads>::BuildPlan* plan, const std::size_t i, const std::size_t tid) {
+    if (plan->built[i].load() != nullptr)
+      return;
+    const auto& task = plan->tasks[i];
+    pNode subtree = build_tree(*plan, task.left, task.right, desc->timestamp, &node_pools_[tid]);
+    pNode expected = nullptr;
+    if (!plan->built[i].compare_exchange_strong(expected, subtree))
+      delete_tree(subtree);
+  }
 
-    if (values.size() == 0) {
-      return {nullptr, true};
+  /**
+   * Link the built subtrees with new top nodes and publish the result
+   * The top nodes are private until they are published, so a thread that finishes late can not modify the new subtree
+   */
+  void finish_cooperative_rebuild(RebuildDescriptor<T, MaxThreads>* desc, typename RebuildDescriptor<T, MaxThreads>::BuildPlan* plan) {
+    std::vector<pNode> top_nodes;
+    std::size_t next_task = 0;
+    pNode root = nullptr;
+    if (plan->size > 0)
+      root = build_top_nodes(*plan, 0, plan->size - 1, plan->depth, desc->timestamp, next_task, top_nodes);
+
+    pNode expected = nullptr;
+    if (desc->result.compare_exchange_strong(expected, root)) {
+      desc->finished.store(true);
+    } else {
+      for (pNode n : top_nodes) {
+        delete n;
+      }
     }
-    return {build_tree(values, 0, values.size()-1, timestamp), true};
+  }
+
+  /**
+   * Counterpart of add_build_tasks, creates the nodes above the subtrees of the tasks
+   */
+  pNode build_top_nodes(const typename RebuildDescriptor<T, MaxThreads>::BuildPlan& plan, std::size_t left, std::size_t right, std::size_t depth, const std::uint64_t timestamp, std::size_t& next_task, std::vector<pNode>& top_nodes) {
+    if (depth == 0)
+      return plan.built[next_task++].load();
+    std::size_t middle = left+((right-left)/2);
+    NodeState init_state(timestamp-1, static_cast<std::uint32_t>(right-left+1), 0);
+    pNode new_node = new Node<T, MaxThreads>(max_threads_, options_.timestamp_source, right-left+1, plan[middle], init_state);
+    top_nodes.push_back(new_node);
+    if (middle > left)
+      new_node->left_child.store(build_top_nodes(plan, left, middle-1, depth-1, timestamp, next_task, top_nodes), boost::memory_order_relaxed);
+    if (middle < right)
+      new_node->right_child.store(build_top_nodes(plan, middle+1, right, depth-1, timestamp, next_task, top_nodes), boost::memory_order_relaxed);
+    return new_node;
+  }
+
+  /**
+   * Build the initial tree from sorted values, using options_.build_threads threads
+   */
+  void build_initial_tree(std::span<const T> values) {
+    if (values.empty())
+      return;
+    fake_root_child.store(build_tree_parallel(values, 0, values.size() - 1, 1, options_.build_threads));
   }
 
   /**
    * Build a perfectly balanced binary tree from the values[left:right+1] (in python notation)
    * The rebuild is triggered by an operation with timestamp "timestamp"
+   * values can be any random access range of sorted values
    */
-  pNode build_tree(std::vector<T>& values, std::size_t left, std::size_t right, const std::uint64_t timestamp) {
+  template <class Values>
+  pNode build_tree(const Values& values, std::size_t left, std::size_t right, const std::uint64_t timestamp, NodePool* pool = nullptr) {
     if (left > right) return nullptr;
+    if (options_.veb_layout)
+      return build_tree_veb(values, left, right+1, timestamp);
     std::size_t middle = left+((right-left)/2);
     NodeState init_state(timestamp-1, static_cast<std::uint32_t>(right-left+1), 0);
-    pNode new_node = new Node<T>(max_threads_, right-left+1, values[middle], init_state);
+    pNode new_node = make_node(pool, right-left+1, values[middle], init_state);
+    if (is_fat_leaf(right-left+1)) {
+      new_node->block = make_leaf_block(values, left, right+1, middle, timestamp);
+      return new_node;
+    }
     pNode left_child = nullptr;
     if (middle != 0) {
-      left_child = build_tree(values, left, middle-1, timestamp);
+      left_child = build_tree(values, left, middle-1, timestamp, pool);
+    }
+    pNode right_child = build_tree(values, middle+1, right, timestamp, pool);
+
+    new_node->left_child.store(left_child, boost::memory_order_relaxed);
+    new_node->right_child.store(right_child, boost::memory_order_relaxed);
+
+    return new_node;
+  }
+
+  /**
+   * Same as build_tree for the values[begin:end], but all nodes are placed in one NodeArena in van Emde Boas order:
+   * the top half of the levels is laid out recursively, followed by the subtrees below it, each laid out recursively as well
+   */
+  template <class Values>
+  pNode build_tree_veb(const Values& values, const std::size_t begin, const std::size_t end, const std::uint64_t timestamp) {
+    //value ranges of the nodes in the order of the layout
+    std::vector<std::pair<std::size_t, std::size_t>> order;
+    order.reserve(end - begin);
+    veb_order(begin, end, subtree_height(end - begin), order);
+
+    auto arena = new NodeArena(order.size(), sizeof(Node<T, MaxThreads>), alignof(Node<T, MaxThreads>));
+    //every node is identified by its middle value
+    std::vector<pNode> nodes(end - begin, nullptr);
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      auto [b, e] = order[i];
+      std::size_t middle = b+((e-b-1)/2);
+      NodeState init_state(timestamp-1, static_cast<std::uint32_t>(e-b), 0);
+      pNode n = new (arena->slot(i)) Node<T, MaxThreads>(max_threads_, options_.timestamp_source, e-b, values[middle], init_state);
+      n->arena = arena;
+      if (is_fat_leaf(e-b))
+        n->block = make_leaf_block(values, b, e, middle, timestamp);
+      nodes[middle-begin] = n;
+    }
+    for (auto [b, e] : order) {
+      if (is_fat_leaf(e-b))
+        continue;
+      std::size_t middle = b+((e-b-1)/2);
+      if (b < middle)
+        nodes[middle-begin]->left_child.store(nodes[b+((middle-b-1)/2)-begin], boost::memory_order_relaxed);
+      if (middle+1 < e)
+        nodes[middle-begin]->right_child.store(nodes[middle+1+((e-middle-2)/2)-begin], boost::memory_order_relaxed);
+    }
+    return nodes[(end-begin-1)/2];
+  }
+
+  /**
+   * Append the value ranges of the nodes in the upper levels levels of the subtree for values[begin:end] in van Emde Boas order to order
+   */
+  void veb_order(const std::size_t begin, const std::size_t end, const std::size_t levels, std::vector<std::pair<std::size_t, std::size_t>>& order) {
+    if (begin == end || levels == 0)
+      return;
+    if (levels == 1) {
+      order.emplace_back(begin, end);
+      return;
+    }
+    const std::size_t top = levels / 2;
+    veb_order(begin, end, top, order);
+    std::vector<std::pair<std::size_t, std::size_t>> bottom;
+    subtrees_at_depth(begin, end, top, bottom);
+    for (auto [b, e] : bottom) {
+      veb_order(b, e, levels - top, order);
+    }
+  }
+
+  /**
+   * Append the value ranges of the subtrees depth levels below the root of the subtree for values[begin:end] to subtrees, from left to right
+   */
+  void subtrees_at_depth(const std::size_t begin, const std::size_t end, const std::size_t depth, std::vector<std::pair<std::size_t, std::size_t>>& subtrees) {
+    if (begin == end)
+      return;
+    if (depth == 0) {
+      subtrees.emplace_back(begin, end);
+      return;
+    }
+    if (is_fat_leaf(end - begin))
+      return;
+    std::size_t middle = begin+((end-begin-1)/2);
+    subtrees_at_depth(begin, middle, depth - 1, subtrees);
+    subtrees_at_depth(middle + 1, end, depth - 1, subtrees);
+  }
+
+  /**
+   * Number of levels of a subtree of size values built by build_tree, the right subtree is never smaller than the left one
+   */
+  std::size_t subtree_height(std::size_t size) {
+    std::size_t height = 0;
+    while (size > 0) {
+      ++height;
+      if (is_fat_leaf(size))
+        break;
+      size -= 1 + (size-1)/2;
+    }
+    return height;
+  }
+
+  /**
+   * Returns true if build_tree turns a subtree of size values into a fat leaf
+   */
+  bool is_fat_leaf(const std::size_t size) {
+    return size > 1 && size-1 <= options_.leaf_block_size;
+  }
+
+  /**
+   * Returns the block of a fat leaf for the values[begin:end] without the one at middle, which is the value of the node
+   */
+  template <class Values>
+  LeafBlock<T>* make_leaf_block(const Values& values, const std::size_t begin, const std::size_t end, const std::size_t middle, const std::uint64_t timestamp) {
+    auto block = new LeafBlock<T>();
+    for (std::size_t i = begin; i < end; ++i) {
+      if (i != middle)
+        block->keys[block->size++] = values[i];
+    }
+    block->state.store(BlockState{timestamp-1, block->valid_mask()}, boost::memory_order_relaxed);
+    return block;
+  }
+
+  /**
+   * Returns a node with the given content, a recycled one from pool if there is one
+   */
+  pNode make_node(NodePool* pool, const std::uint64_t init_size, const T value, NodeState init_state) {
+    if (pool == nullptr || pool->nodes.empty())
+      return new Node<T, MaxThreads>(max_threads_, options_.timestamp_source, init_size, value, init_state);
+    pNode n = pool->nodes.back();
+    pool->nodes.pop_back();
+    n->ops.reset(init_state.get_last_timestamp());
+    n->state.store(init_state, boost::memory_order_relaxed);
+    n->init_size = init_size;
+    n->value = value;
+    n->left_child.store(nullptr, boost::memory_order_relaxed);
+    n->right_child.store(nullptr, boost::memory_order_relaxed);
+    return n;
+  }
+
+  /**
+   * Same as build_tree, but the disjoint subtrees are built by up to num_threads threads
+   * The left subtree is handed to a new thread until every thread has its own subtree
+   */
+  pNode build_tree_parallel(std::span<const T> values, std::size_t left, std::size_t right, const std::uint64_t timestamp, std::size_t num_threads) {
+    constexpr std::size_t kMinParallelSize = 1 << 14;
+    if (num_threads <= 1 || left > right || right - left < kMinParallelSize)
+      return build_tree(values, left, right, timestamp);
+
+    std::size_t middle = left+((right-left)/2);
+    NodeState init_state(timestamp-1, static_cast<std::uint32_t>(right-left+1), 0);
+    pNode new_node = new Node<T, MaxThreads>(max_threads_, options_.timestamp_source, right-left+1, values[middle], init_state);
+    pNode left_child = nullptr;
+    pNode right_child = nullptr;
+    {
+      std::jthread worker([&] {
+        if (middle != 0)
+          left_child = build_tree_parallel(values, left, middle-1, timestamp, num_threads/2);
+      });
+      right_child = build_tree_parallel(values, middle+1, right, timestamp, num_threads - num_threads/2);
     }
-    pNode right_child = build_tree(values, middle+1, right, timestamp);
 
-    new_node->left_child.store(left_child);
-    new_node->right_child.store(right_child);
+    new_node->left_child.store(left_child, boost::memory_order_relaxed);
+    new_node->right_child.store(right_child, boost::memory_order_relaxed);
 
     return new_node;
   }
 
+  /**
+   * Splits the subtree rooted at n into the nodes with value < key and value >= key, and returns both parts
+   * Nodes that are relinked get their size recalculated
+   */
+  std::pair<pNode, pNode> split_subtree(const pNode n, const T key) {
+    if (n == nullptr)
+      return {nullptr, nullptr};
+    if (n->value < key) {
+      std::pair<pNode, pNode> lower_upper = split_subtree(n->right_child.load(), key);
+      n->right_child.store(lower_upper.first);
+      reset_subtree_size(n);
+      return {n, lower_upper.second};
+    }
+    std::pair<pNode, pNode> lower_upper = split_subtree(n->left_child.load(), key);
+    n->left_child.store(lower_upper.second);
+    reset_subtree_size(n);
+    return {lower_upper.first, n};
+  }
+
+  /**
+   * Joins the subtrees lower and upper, all values in lower have to be smaller than the values in upper
+   * The smallest node of upper is used as new parent of two subtrees of similar size
+   */
+  pNode join(const pNode lower, const pNode upper) {
+    std::pair<pNode, pNode> rest_min = remove_min(upper);
+    return join_with(lower, rest_min.second, rest_min.first);
+  }
+
+  /**
+   * Unlinks the node with the smallest value from the subtree rooted at n
+   * Returns the new root of the subtree and the unlinked node
+   */
+  std::pair<pNode, pNode> remove_min(const pNode n) {
+    pNode left = n->left_child.load();
+    if (left == nullptr)
+      return {n->right_child.load(), n};
+    std::pair<pNode, pNode> rest_min = remove_min(left);
+    n->left_child.store(rest_min.first);
+    reset_subtree_size(n);
+    return {n, rest_min.second};
+  }
+
+  /**
+   * Joins lower, pivot and upper (in that order) by descending into the larger subtree until both sides have a similar size
+   */
+  pNode join_with(const pNode lower, const pNode pivot, const pNode upper) {
+    std::uint64_t lower_size = subtree_size(lower);
+    std::uint64_t upper_size = subtree_size(upper);
+    if (lower_size > 2*upper_size + 1) {
+      lower->right_child.store(join_with(lower->right_child.load(), pivot, upper));
+      reset_subtree_size(lower);
+      return lower;
+    }
+    if (upper_size > 2*lower_size + 1) {
+      upper->left_child.store(join_with(lower, pivot, upper->left_child.load()));
+      reset_subtree_size(upper);
+      return upper;
+    }
+    pivot->left_child.store(lower);
+    pivot->right_child.store(upper);
+    reset_subtree_size(pivot);
+    return pivot;
+  }
+
+  std::uint64_t subtree_size(const pNode n) {
+    if (n == nullptr)
+      return 0;
+    return n->state.load().all_children;
+  }
+
+  pNode min_node(pNode n) {
+    while (n->left_child.load() != nullptr)
+      n = n->left_child.load();
+    return n;
+  }
+
+  pNode max_node(pNode n) {
+    while (n->right_child.load() != nullptr)
+      n = n->right_child.load();
+    return n;
+  }
+
+  /**
+   * Recalculates the number of active nodes in the subtree of n from its children
+   * As the subtree was changed as a whole, this also restarts the rebuild accounting of n
+   */
+  void reset_subtree_size(const pNode n) {
+    //an unfinished incremental rebuild of n does not know about the relinked nodes
+    delete n->rebuild.exchange(nullptr);
+    NodeState curr_state = n->state.load();
+    std::uint64_t size = curr_state.get_active() + subtree_size(n->left_child.load()) + subtree_size(n->right_child.load());
+    n->state.store(NodeState(curr_state.get_last_timestamp(), static_cast<std::uint32_t>(size), 0, curr_state.get_active()));
+    n->init_size = size;
+  }
+
+  /**
+   * Same as delete_tree, but up to options_.node_pool_size nodes are kept in the pool of tid to be reused by rebuilds
+   * No thread is allowed to access the subtree anymore
+   */
+  void recycle_tree(pNode del, const std::size_t tid) {
+    NodePool& pool = node_pools_[tid];
+    pNode n = del;
+    while (n != nullptr) {
+      if (rotate_left_child(n))
+        continue;
+      pNode next = n->right_child.load(boost::memory_order_relaxed);
+      if (pool.nodes.size() >= options_.node_pool_size) {
+        delete n;
+        n = next;
+        continue;
+      }
+      delete n->rebuild.exchange(nullptr);
+      delete n->block;
+      n->block = nullptr;
+      pool.nodes.push_back(n);
+      n = next;
+    }
+  }
+
   /**
    * Delete the whole subtree rooted at del
+   * The caller owns the subtree, whatever handed it over (a failed CAS or set_mask_ in release_nodes) already ordered
+   * all earlier accesses of other threads before this, so the links are read relaxed and no fence per node is needed
    */
   void delete_tree(pNode del) {
-    std::queue<pNode> q;
-    q.push(del);
-    while (!q.empty()) {
-      auto n = q.front();
-      q.pop();
-      if (n->left_child.load() != nullptr)
-        q.push(n->left_child.load());
-      if (n->right_child.load() != nullptr)
-        q.push(n->right_child.load());
-      std::atomic_thread_fence(std::memory_order_seq_cst);
+    pNode n = del;
+    while (n != nullptr) {
+      if (rotate_left_child(n))
+        continue;
+      pNode next = n->right_child.load(boost::memory_order_relaxed);
       delete n;
+      n = next;
     }
   }
+
+  /**
+   * Rotates the left child of n up into the place of n, so a subtree can be deleted without a stack by always deleting a root without left child
+   * Returns false if n has no left child
+   */
+  static bool rotate_left_child(pNode& n) {
+    pNode left = n->left_child.load(boost::memory_order_relaxed);
+    if (left == nullptr)
+      return false;
+    n->left_child.store(left->right_child.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+    left->right_child.store(n, boost::memory_order_relaxed);
+    n = left;
+    return true;
+  }
 };
\ No newline at end of file
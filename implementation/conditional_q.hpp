@@ -1,19 +1,24 @@
 #pragma once
 
 #include "implementation/hazard_pointers.hpp"
+#include "implementation/thread_slots.hpp"
+#include "implementation/timestamps.hpp"
 
 #include <memory>
 #include <iostream>
 #include <cstdint>
 #include <limits>
+#include <span>
 
 #include <boost/atomic/atomic.hpp>
 
 /**
  * Adaptation of the WaitFree Queue that only allows values to be inserted in a specific order.
  * T has to have a member called timestamp.
+ * With MaxThreads > 0 the announcements and hazard pointers of the threads are stored inline (see ThreadSlots).
+ * Padded puts the announcement and hazard pointers of every thread on their own cache lines.
  */
-template <class T>
+template <class T, std::size_t MaxThreads = 0, bool Padded = true>
 class ConditionalQ {
 private:
   struct Node {
@@ -23,6 +28,8 @@ private:
     T* value;
     //without being atomic this causes data races, not sure why
     boost::atomic<std::uint64_t> timestamp; //same as value->timestamp
+    //linked together with its predecessor by push_if_batch
+    bool chained = false;
   };
 
   enum OpType {
@@ -77,23 +84,32 @@ private:
   boost::atomic<pNode> head;
   boost::atomic<pNode> tail;
 
-  HazardPointers<Node> hp;
+  HazardPointers<Node, MaxThreads, (MaxThreads > 0 ? 3 : 0), Padded> hp;
 
   static constexpr int kHpTail = 0;
   static constexpr int kHpHead = 1;
   static constexpr int kHpNext = 2;
   static constexpr int kHpInsertNode = 1;
 
-  std::vector<boost::atomic<OpDesc>> opdescs_;
+  ThreadSlots<boost::atomic<OpDesc>, MaxThreads, Padded> opdescs_;
   boost::atomic<std::uint64_t> next_timestamp_ = 1;
+  const TimestampSource timestamps_ = TimestampSource::kCounter;
+
+  //the phases only have to grow and be unique, so the TSC can replace the counter
+  std::uint64_t new_timestamp(std::size_t tid) {
+    if (timestamps_ == TimestampSource::kTsc)
+      return tsc_timestamp(tid);
+    return next_timestamp_.fetch_add(1);
+  }
 
   bool isStillPending(const std::size_t i, const std::uint64_t timestamp) const {
     OpDesc d = opdescs_[i].load();
     return d.get_type() != OpType::kNotPending && d.get_timestamp() <= timestamp;
   }
 
+  //the announcements are stored and loaded seq_cst, a thread that announced must see every older announcement in this scan
   void help(std::uint64_t timestamp, std::size_t tid) {
-    for (std::size_t i = 0; i < max_threads_; ++i) {
+    for (std::size_t i = 0; i < opdescs_.size(); ++i) {
       OpDesc d = opdescs_[i].load();
       if (d.get_type() != OpType::kNotPending && d.get_timestamp() <= timestamp) {
         if (d.get_type() == OpType::kPush) {
@@ -131,13 +147,18 @@ private:
           std::uint64_t tail_ts = curr_tail->timestamp;
           std::uint64_t node_ts = d.node->timestamp;
           if (tail_ts >= node_ts) {
-            OpDesc new_d = OpDesc::create_with_node(nullptr, d.get_timestamp(), OpType::kNotPending);
+            //the rest of a batch can still be newer than the tail, so only its first node is dropped
+            pNode rest = d.node->next.load();
+            OpDesc new_d = rest != nullptr ? OpDesc::create_with_node(rest, d.get_timestamp(), OpType::kPush)
+                                           : OpDesc::create_with_node(nullptr, d.get_timestamp(), OpType::kNotPending);
             if (opdescs_[i].compare_exchange_strong(d, new_d))
               hp.retire(d.node, tid);
             hp.clearOne(kHpTail, tid);
             hp.clearOne(kHpNext, tid);
             hp.clearOne(kHpInsertNode, tid);
-            return;
+            if (rest == nullptr)
+              return;
+            continue;
           }
         }
 
@@ -174,6 +195,9 @@ private:
         OpDesc new_d = OpDesc::create_with_node(d.node, d.get_timestamp(), OpType::kNotPending);
         opdescs_[i].compare_exchange_strong(d, new_d);
         tail.compare_exchange_strong(curr_tail, curr_next);
+      } else if (curr_tail == tail.load() && curr_next->chained) {
+        //the batch was already completed when its first node was passed
+        tail.compare_exchange_strong(curr_tail, curr_next);
       }
     }
     hp.clearOne(kHpTail, tid);
@@ -310,34 +334,65 @@ private:
   }
 
 public:
-  ConditionalQ(std::size_t max_threads) : max_threads_(max_threads), hp(3, max_threads), opdescs_(max_threads) {
+  /**
+   * Values with a timestamp <= min_timestamp are never inserted
+   * timestamps selects where the phases of the queue operations come from
+   */
+  ConditionalQ(std::size_t max_threads, std::uint64_t min_timestamp = 0, TimestampSource timestamps = TimestampSource::kCounter)
+      : max_threads_(MaxThreads > 0 ? MaxThreads : max_threads), hp(3, max_threads), opdescs_(max_threads), timestamps_(timestamps) {
+    //nothing is shared before the constructor returns, the thread that hands the queue to others publishes it
     pNode n = new Node;
-    n->next = nullptr;
+    n->next.store(nullptr, boost::memory_order_relaxed);
     n->push_tid = 0;
-    n->pop_tid = max_threads_;
+    n->pop_tid.store(max_threads_, boost::memory_order_relaxed);
     n->value = nullptr;
-    n->timestamp = std::uint64_t{};
-    head.store(n);
-    tail.store(n);
+    n->timestamp.store(min_timestamp, boost::memory_order_relaxed);
+    head.store(n, boost::memory_order_relaxed);
+    tail.store(n, boost::memory_order_relaxed);
 
     // std::cout << "Lockfree OpDesc: " << opdescs_[0].is_lock_free() << std::endl;
     // std::cout << "OpDesc siz: " << sizeof(OpDesc) << std::endl;
   }
 
   ~ConditionalQ() {
-    pNode n = head.load();
+    pNode n = head.load(boost::memory_order_relaxed);
     do {
-      pNode tmp = n->next.load();
+      pNode tmp = n->next.load(boost::memory_order_relaxed);
       delete n;
       n = tmp;
     } while (n != nullptr);
   }
 
+  /**
+   * Removes all values, so the queue can be reused without allocating the hazard pointers and descriptors again
+   * Afterwards it behaves like a new queue with the given min_timestamp
+   * Must only be called when no thread accesses the queue anymore
+   */
+  void reset(std::uint64_t min_timestamp) {
+    pNode n = head.load(boost::memory_order_relaxed);
+    pNode next = n->next.load(boost::memory_order_relaxed);
+    while (next != nullptr) {
+      pNode tmp = next->next.load(boost::memory_order_relaxed);
+      delete next;
+      next = tmp;
+    }
+    n->next.store(nullptr, boost::memory_order_relaxed);
+    n->push_tid = 0;
+    n->pop_tid.store(max_threads_, boost::memory_order_relaxed);
+    n->value = nullptr;
+    n->timestamp.store(min_timestamp, boost::memory_order_relaxed);
+    tail.store(n, boost::memory_order_relaxed);
+    for (std::size_t i = 0; i < opdescs_.size(); ++i) {
+      opdescs_[i].store(OpDesc(), boost::memory_order_relaxed);
+      hp.clear(i);
+    }
+  }
+
   /**
    * Returns the value at the front of the queue
    */
   [[nodiscard]] T* peek(std::size_t tid) {
-    std::uint64_t timestamp = next_timestamp_.fetch_add(1);
+    std::uint64_t timestamp = new_timestamp(tid);
     OpDesc d = OpDesc::create_with_value(nullptr, timestamp, OpType::kPeek);
     opdescs_[tid].store(d);
     help(timestamp, tid);
@@ -347,30 +402,109 @@ public:
     return d.value;
   }
 
+  /**
+   * Like peek, but the returned value is also protected by hazard pointer index of value_hp
+   * It is only returned after checking that it was still at the front after the hazard pointer was published,
+   * so it can not have been popped and retired, and callers do not have to peek a second time to validate it
+   */
+  template <std::size_t ValueMaxThreads, std::size_t ValueMaxHPs, bool ValuePadded>
+  [[nodiscard]] T* peek_protected(HazardPointers<T, ValueMaxThreads, ValueMaxHPs, ValuePadded>& value_hp, std::size_t index, std::size_t tid) {
+    while (true) {
+      T* value = value_hp.protectPtr(index, peek(tid), tid);
+      if (value == nullptr || is_front(value, tid))
+        return value;
+    }
+  }
+
+  /**
+   * Returns true if value is at the front of the queue
+   * This only reads the head, so it is a cheap way to validate a hazard pointer to value that was published before
+   */
+  [[nodiscard]] bool is_front(const T* value, std::size_t tid) {
+    pNode curr_head = hp.protect(kHpHead, head, tid);
+    pNode curr_next = hp.protectPtr(kHpNext, curr_head->next.load(), tid);
+    //the next node is only retired after the head moved past it
+    bool front = curr_head == head.load() && curr_next != nullptr && curr_next->value == value;
+    hp.clearOne(kHpHead, tid);
+    hp.clearOne(kHpNext, tid);
+    return front;
+  }
+
+  /**
+   * Returns false if a value with timestamp would not be accepted by push_if anymore
+   * The tail can lag behind the last node, which only has a larger timestamp, so true does not mean that the push will succeed
+   */
+  [[nodiscard]] bool newer_than_tail(std::uint64_t timestamp, std::size_t tid) {
+    pNode curr_tail = hp.protect(kHpTail, tail, tid);
+    //the timestamp of a node never changes after it was published, the protected load of the tail already ordered it
+    bool newer = curr_tail->timestamp.load(boost::memory_order_relaxed) < timestamp;
+    hp.clearOne(kHpTail, tid);
+    return newer;
+  }
+
   /**
    * Adds value to the queue iff the current tail of the queue has a smaller timestamp
    */
   void push_if(T* value, std::size_t tid) {
+    //a push that can not succeed anymore does not need a node
+    if (!newer_than_tail(value->timestamp, tid))
+      return;
+    //the node is published by the seq_cst store of the announcement, which orders these stores before it
     pNode n = new Node;
-    n->next = nullptr;
+    n->next.store(nullptr, boost::memory_order_relaxed);
     n->push_tid = tid;
     n->value = value;
-    n->pop_tid = max_threads_;
-    n->timestamp.store(value->timestamp);
+    n->pop_tid.store(max_threads_, boost::memory_order_relaxed);
+    n->timestamp.store(value->timestamp, boost::memory_order_relaxed);
 
-    std::uint64_t timestamp = next_timestamp_.fetch_add(1);
+    std::uint64_t timestamp = new_timestamp(tid);
     OpDesc d = OpDesc::create_with_node(n, timestamp, OpType::kPush);
     opdescs_[tid].store(d);
     help(timestamp, tid);
     help_finish_push(tid);
   }
 
+  /**
+   * Adds values, which have to be sorted by ascending timestamp, like calling push_if for each of them, but with a single announcement and helping round
+   * The values are linked to a chain first, which is appended in one step after dropping the values at its front that are not newer than the tail
+   */
+  void push_if_batch(std::span<T* const> values, std::size_t tid) {
+    while (!values.empty() && !newer_than_tail(values.front()->timestamp, tid)) {
+      values = values.subspan(1);
+    }
+    if (values.empty())
+      return;
+    pNode first = nullptr;
+    pNode last = nullptr;
+    //like in push_if the chain is private until the announcement
+    for (T* value : values) {
+      pNode n = new Node;
+      n->next.store(nullptr, boost::memory_order_relaxed);
+      n->push_tid = tid;
+      n->value = value;
+      n->pop_tid.store(max_threads_, boost::memory_order_relaxed);
+      n->timestamp.store(value->timestamp, boost::memory_order_relaxed);
+      n->chained = last != nullptr;
+      if (last != nullptr)
+        last->next.store(n, boost::memory_order_relaxed);
+      else
+        first = n;
+      last = n;
+    }
+
+    std::uint64_t timestamp = new_timestamp(tid);
+    OpDesc d = OpDesc::create_with_node(first, timestamp, OpType::kPush);
+    opdescs_[tid].store(d);
+    help(timestamp, tid);
+    help_finish_push(tid);
+  }
+
   /**
    * Removes the first value from the queue if its timestamp is timestamp_a
    * Does not return the removed value
    */
   void pop_if(std::uint64_t timestamp_a, std::size_t tid) {
-    std::uint64_t timestamp = next_timestamp_.fetch_add(1);
+    std::uint64_t timestamp = new_timestamp(tid);
     OpDesc d = OpDesc::create_with_timestamp(timestamp_a, timestamp, OpType::kPop);
     opdescs_[tid].store(d);
     help(timestamp, tid);
@@ -29,17 +29,22 @@
 
 #pragma once
 
+#include <array>
 #include <iostream>
 #include <functional>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 
+#include "implementation/thread_slots.hpp"
+
 #include <boost/atomic/atomic.hpp>
 
 /**
  * Hazard Pointer class with some adapations to save some memory
  * See original authors above
  */
-template<typename T>
+template<typename T, std::size_t MaxThreads = 0, std::size_t MaxHPs = 0, bool Padded = true>
 class HazardPointers {
 
 private:
@@ -52,25 +57,58 @@ private:
   const std::size_t             maxHPs_;
   const std::size_t             maxThreads_;
 
-  std::vector<std::vector<boost::atomic<T*>>> hp;
-  // It's not nice that we have a lot of empty vectors, but we need padding to avoid false sharing
-  std::vector<std::vector<T*>> retiredList;
+  static constexpr std::size_t kHPsPerLine = 64 / sizeof(boost::atomic<T*>);
+
+  struct alignas(64) HPLine {
+    std::array<boost::atomic<T*>, kHPsPerLine> ptrs;
+  };
+
+  // with MaxHPs > 0 the hazard pointers of a thread are stored inline, otherwise on the heap, with Padded in whole cache lines
+  using HPList = std::conditional_t<(MaxHPs > 0), std::array<boost::atomic<T*>, MaxHPs>,
+                                    std::conditional_t<Padded, std::vector<HPLine>, std::vector<boost::atomic<T*>>>>;
+
+  ThreadSlots<HPList, MaxThreads, Padded> hp;
+  ThreadSlots<std::vector<T*>, MaxThreads, Padded> retiredList;
+
+  boost::atomic<T*>& hazard(std::size_t tid, std::size_t ihp) {
+    if constexpr (MaxHPs == 0 && Padded)
+      return hp[tid][ihp / kHPsPerLine].ptrs[ihp % kHPsPerLine];
+    else
+      return hp[tid][ihp];
+  }
+
+  std::size_t threads() const {
+    if constexpr (MaxThreads > 0)
+      return MaxThreads;
+    else
+      return maxThreads_;
+  }
+
+  std::size_t hps() const {
+    if constexpr (MaxHPs > 0)
+      return MaxHPs;
+    else
+      return maxHPs_;
+  }
 public:
 
   HazardPointers(std::size_t maxHPs, std::size_t maxThreads) : maxHPs_{maxHPs}, 
                                                                maxThreads_{maxThreads}, 
                                                                hp(maxThreads_), 
                                                                retiredList(maxThreads_) {
-    for (std::size_t i = 0; i < maxThreads_; ++i) {
-      hp[i] = std::vector<boost::atomic<T*>>(maxHPs_);
-      for (std::size_t j = 0; j < maxHPs_; ++j) {
-        hp[i][j].store(nullptr);
+    if (maxHPs_ > hps())
+      throw std::invalid_argument("More hazard pointers than MaxHPs");
+    for (std::size_t i = 0; i < threads(); ++i) {
+      if constexpr (MaxHPs == 0)
+        hp[i] = HPList(Padded ? (maxHPs_ + kHPsPerLine - 1) / kHPsPerLine : maxHPs_);
+      for (std::size_t j = 0; j < hps(); ++j) {
+        hazard(i, j).store(nullptr, boost::memory_order_relaxed);
       }
     }
   }
 
   ~HazardPointers() {
-    for (std::size_t ithread = 0; ithread < maxThreads_; ithread++) {
+    for (std::size_t ithread = 0; ithread < threads(); ithread++) {
       // Clear the current retired nodes
       for (std::size_t iret = 0; iret < retiredList[ithread].size(); iret++) {
         delete retiredList[ithread][iret];
@@ -80,11 +118,12 @@ public:
 
 
   /**
+   * Release orders all accesses to the protected objects before the clear, a retire that sees nullptr may free them
    * Progress Condition: wait-free bounded (by maxHPs_)
    */
   void clear(const std::size_t tid) {
-    for (std::size_t ihp = 0; ihp < maxHPs_; ihp++) {
-      hp[tid][ihp].store(nullptr);
+    for (std::size_t ihp = 0; ihp < hps(); ihp++) {
+      hazard(tid, ihp).store(nullptr, boost::memory_order_release);
     }
   }
 
@@ -93,7 +132,7 @@ public:
    * Progress Condition: wait-free population oblivious
    */
   void clearOne(std::size_t ihp, const std::size_t tid) {
-    hp[tid][ihp].store(nullptr);
+    hazard(tid, ihp).store(nullptr, boost::memory_order_release);
   }
 
 
@@ -104,21 +143,22 @@ public:
     T* n = nullptr;
     T* ret;
     while ((ret = atom.load()) != n) {
-      hp[tid][index].store(ret);
+      hazard(tid, index).store(ret);
       n = ret;
     }
     return ret;
   }
 
   T* get(std::size_t index, const std::size_t tid){
-    return hp[tid][index].load();
+    return hazard(tid, index).load(boost::memory_order_relaxed);
   }
   /**
    * This returns the same value that is passed as ptr, which is sometimes useful
+   * The store stays seq_cst, it has to be visible to retire before the caller validates ptr with its next load
    * Progress Condition: wait-free population oblivious
    */
   T* protectPtr(std::size_t index, T* ptr, const std::size_t tid) {
-    hp[tid][index].store(ptr);
+    hazard(tid, index).store(ptr);
     return ptr;
   }
 
@@ -129,7 +169,7 @@ public:
    * Progress Condition: wait-free population oblivious
    */
   T* protectPtrRelease(std::size_t index, T* ptr, const std::size_t tid) {
-    hp[tid][index].store(ptr);
+    hazard(tid, index).store(ptr, boost::memory_order_release);
     return ptr;
   }
 
@@ -143,9 +183,9 @@ public:
     for (unsigned iret = 0; iret < retiredList[tid].size();) {
       auto obj = retiredList[tid][iret];
       bool canDelete = true;
-      for (std::size_t i = 0; i < maxThreads_ && canDelete; ++i) {
-        for (std::size_t ihp = 0; ihp < maxHPs_; ++ihp) {
-          if (hp[i][ihp].load() == obj) {
+      for (std::size_t i = 0; i < threads() && canDelete; ++i) {
+        for (std::size_t ihp = 0; ihp < hps(); ++ihp) {
+          if (hazard(i, ihp).load() == obj) {
             canDelete = false;
             break;
           }
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include <boost/atomic/atomic.hpp>
+
+/**
+ * Which keys of a LeafBlock are part of the tree, together with the timestamp of the last update that changed it
+ */
+struct BlockState {
+  std::uint64_t timestamp = 0;
+  std::uint64_t active = 0;
+};
+
+/**
+ * Sorted keys of a fat leaf, which are stored next to each other instead of in a node each (see TreeOptions::leaf_block_size)
+ * The keys never change after the block was built, inserts and removes only flip their bit in the active bitmap.
+ * Keys that are not part of the block are inserted below the node of the fat leaf as usual.
+ * The searches compare all keys at once, with AVX-512 or AVX2 for 32 and 64 bit integers and a loop the compiler can vectorize otherwise.
+ */
+template <class T>
+struct LeafBlock {
+  static constexpr std::size_t kMaxSize = 64;
+
+  boost::atomic<BlockState> state;
+  std::uint32_t size = 0;
+  alignas(64) T keys[kMaxSize] = {};
+
+  /**
+   * Bitmask of the valid key slots
+   */
+  std::uint64_t valid_mask() const {
+    return size == kMaxSize ? ~std::uint64_t{0} : (std::uint64_t{1} << size) - 1;
+  }
+
+  /**
+   * Returns the index of key in the block or -1 if it is not part of it
+   */
+  int find(const T key) const {
+    std::uint64_t mask = equal_mask(key) & valid_mask();
+    return mask == 0 ? -1 : std::countr_zero(mask);
+  }
+
+  /**
+   * Bitmask of the keys in the closed interval [lower, upper]
+   */
+  std::uint64_t range_mask(const T lower, const T upper) const {
+    return ~less_mask(lower) & (less_mask(upper) | equal_mask(upper)) & valid_mask();
+  }
+
+private:
+  static constexpr bool kSimd = std::is_integral_v<T> && std::is_signed_v<T> && (sizeof(T) == 4 || sizeof(T) == 8);
+
+  std::uint64_t less_mask(const T key) const {
+#if defined(__AVX2__) || defined(__AVX512F__)
+    if constexpr (kSimd)
+      return simd_mask<true>(key);
+#endif
+    std::uint64_t mask = 0;
+    for (std::size_t i = 0; i < kMaxSize; ++i) {
+      mask |= static_cast<std::uint64_t>(keys[i] < key) << i;
+    }
+    return mask;
+  }
+
+  std::uint64_t equal_mask(const T key) const {
+#if defined(__AVX2__) || defined(__AVX512F__)
+    if constexpr (kSimd)
+      return simd_mask<false>(key);
+#endif
+    std::uint64_t mask = 0;
+    for (std::size_t i = 0; i < kMaxSize; ++i) {
+      mask |= static_cast<std::uint64_t>(keys[i] == key) << i;
+    }
+    return mask;
+  }
+
+#if defined(__AVX512F__)
+  //one bit per key for keys[i] < key (less = true) or keys[i] == key
+  template <bool less>
+  std::uint64_t simd_mask(const T key) const {
+    std::uint64_t mask = 0;
+    if constexpr (sizeof(T) == 4) {
+      const __m512i k = _mm512_set1_epi32(static_cast<int>(key));
+      for (std::size_t i = 0; i < kMaxSize; i += 16) {
+        __m512i v = _mm512_load_si512(reinterpret_cast<const void*>(keys + i));
+        std::uint64_t m = less ? _mm512_cmplt_epi32_mask(v, k) : _mm512_cmpeq_epi32_mask(v, k);
+        mask |= m << i;
+      }
+    } else {
+      const __m512i k = _mm512_set1_epi64(static_cast<long long>(key));
+      for (std::size_t i = 0; i < kMaxSize; i += 8) {
+        __m512i v = _mm512_load_si512(reinterpret_cast<const void*>(keys + i));
+        std::uint64_t m = less ? _mm512_cmplt_epi64_mask(v, k) : _mm512_cmpeq_epi64_mask(v, k);
+        mask |= m << i;
+      }
+    }
+    return mask;
+  }
+#elif defined(__AVX2__)
+  //one bit per key for keys[i] < key (less = true) or keys[i] == key
+  template <bool less>
+  std::uint64_t simd_mask(const T key) const {
+    std::uint64_t mask = 0;
+    if constexpr (sizeof(T) == 4) {
+      const __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+      for (std::size_t i = 0; i < kMaxSize; i += 8) {
+        __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + i));
+        __m256i c = less ? _mm256_cmpgt_epi32(k, v) : _mm256_cmpeq_epi32(v, k);
+        mask |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(c)))) << i;
+      }
+    } else {
+      const __m256i k = _mm256_set1_epi64x(static_cast<long long>(key));
+      for (std::size_t i = 0; i < kMaxSize; i += 4) {
+        __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + i));
+        __m256i c = less ? _mm256_cmpgt_epi64(k, v) : _mm256_cmpeq_epi64(v, k);
+        mask |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(c)))) << i;
+      }
+    }
+    return mask;
+  }
+#endif
+};
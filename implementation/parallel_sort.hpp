@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <thread>
+#include <vector>
+
+/**
+ * Sorts values using up to num_threads threads
+ * The input is split into one chunk per thread, each chunk is sorted with std::sort
+ * and the sorted chunks are merged pairwise in parallel afterwards.
+ */
+template <class T>
+void parallel_sort(std::span<T> values, std::size_t num_threads) {
+  constexpr std::size_t kMinChunkSize = 1 << 16;
+  num_threads = std::min(num_threads, values.size() / kMinChunkSize);
+  if (num_threads <= 1) {
+    std::sort(values.begin(), values.end());
+    return;
+  }
+
+  std::vector<std::size_t> bounds(num_threads + 1);
+  for (std::size_t i = 0; i <= num_threads; ++i) {
+    bounds[i] = values.size() * i / num_threads;
+  }
+
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (std::size_t i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        std::sort(values.begin() + static_cast<std::ptrdiff_t>(bounds[i]), values.begin() + static_cast<std::ptrdiff_t>(bounds[i+1]));
+      });
+    }
+  }
+
+  //merge neighbouring chunks, doubling the width of the sorted runs in every round
+  for (std::size_t width = 1; width < num_threads; width *= 2) {
+    std::vector<std::jthread> threads;
+    for (std::size_t i = 0; i + width < num_threads; i += 2 * width) {
+      threads.emplace_back([&, i] {
+        auto first = values.begin() + static_cast<std::ptrdiff_t>(bounds[i]);
+        auto middle = values.begin() + static_cast<std::ptrdiff_t>(bounds[i + width]);
+        auto last = values.begin() + static_cast<std::ptrdiff_t>(bounds[std::min(i + 2 * width, num_threads)]);
+        std::inplace_merge(first, middle, last);
+      });
+    }
+  }
+}
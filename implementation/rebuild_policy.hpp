@@ -0,0 +1,149 @@
+#pragma once
+
+#include "tree_internals.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <boost/atomic/atomic.hpp>
+
+/**
+ * A rebuild policy decides when the subtree of a node gets rebuilt, it is the RebuildPolicy template parameter of ConcurrentTree
+ * It is constructed with the number of thread ids of the tree and has to provide the following functions, which are called concurrently:
+ *  - bool should_rebuild(std::uint64_t init_size, NodeState state): called for every child an operation passes, with its size after the last rebuild and its current state
+ *  - void record_read(std::size_t tid) / record_write(std::size_t tid): called once per lookup/range query and insert/remove
+ *  - void record_rebuild(std::uint64_t size, std::uint64_t nanoseconds): called after a subtree of size nodes was rebuilt inline
+ */
+
+/**
+ * Returns true if more than init_size/divisor updates passed the subtree since its last rebuild
+ * Subtrees with at most 5 nodes are never rebuilt
+ */
+inline bool exceeds_rebuild_threshold(const std::uint64_t init_size, NodeState state, const std::uint32_t divisor) {
+  return state.changes > init_size/divisor && (state.all_children > 5 || init_size > 5);
+}
+
+/**
+ * Rebuilds a subtree once the number of updates exceeds half of its size, like proposed in the paper
+ * The amortized rebuild work per update is O(log n)
+ */
+struct DefaultRebuildPolicy {
+  explicit DefaultRebuildPolicy(std::size_t) {}
+
+  bool should_rebuild(const std::uint64_t init_size, NodeState state) const {
+    return exceeds_rebuild_threshold(init_size, state, 2);
+  }
+
+  void record_read(std::size_t) {}
+  void record_write(std::size_t) {}
+  void record_rebuild(std::uint64_t, std::uint64_t) {}
+};
+
+/**
+ * Rebuilds a subtree once the number of updates exceeds init_size/divisor, which bounds the depth of the tree
+ * Directly after a rebuild both children have half of the size, until the next rebuild a child can hold at most
+ * (1/2 + 1/divisor) / (1 - 1/divisor) of the nodes of its parent, so the depth stays below
+ * log2(n) / log2((1 - 1/divisor) / (1/2 + 1/divisor)), which is about 2.1 * log2(n) for divisor = 8 and 1.4 * log2(n) for divisor = 16.
+ * The rebuild work per update grows linearly with divisor, so this is meant for read-heavy trees.
+ */
+template <std::uint32_t divisor = 8>
+struct DepthBoundRebuildPolicy {
+  static_assert(divisor > 2, "The depth is only bounded for divisors larger than 2");
+
+  explicit DepthBoundRebuildPolicy(std::size_t) {}
+
+  bool should_rebuild(const std::uint64_t init_size, NodeState state) const {
+    return exceeds_rebuild_threshold(init_size, state, divisor);
+  }
+
+  void record_read(std::size_t) {}
+  void record_write(std::size_t) {}
+  void record_rebuild(std::uint64_t, std::uint64_t) {}
+};
+
+/**
+ * Rebuilds a subtree once the number of updates exceeds init_size/divisor, where divisor is tuned to the observed workload
+ * divisor = 2 * reads/writes, scaled by how cheap rebuilds are compared to kCheapNodeNs per node and clamped to [kMinDivisor, kMaxDivisor].
+ * So a balanced workload behaves like DefaultRebuildPolicy, read-heavy ones keep the tree flatter
+ * and write-heavy ones or expensive rebuilds (large or cache-unfriendly keys) rebuild less often.
+ * Every thread counts its own operations, the thread that completes kWindow operations recomputes divisor from the operations since the last recomputation.
+ */
+class AdaptiveRebuildPolicy {
+public:
+  static constexpr std::uint32_t kMinDivisor = 2;
+  static constexpr std::uint32_t kMaxDivisor = 16;
+  static constexpr std::uint64_t kWindow = 1 << 12;
+  static constexpr double kCheapNodeNs = 50.0;
+
+  explicit AdaptiveRebuildPolicy(std::size_t max_threads) : counters_(max_threads) {}
+
+  bool should_rebuild(const std::uint64_t init_size, NodeState state) const {
+    return exceeds_rebuild_threshold(init_size, state, divisor_.load(boost::memory_order_relaxed));
+  }
+
+  void record_read(const std::size_t tid) {
+    count(counters_[tid].reads, counters_[tid].writes);
+  }
+
+  void record_write(const std::size_t tid) {
+    count(counters_[tid].writes, counters_[tid].reads);
+  }
+
+  void record_rebuild(const std::uint64_t size, const std::uint64_t nanoseconds) {
+    rebuilt_nodes_.fetch_add(size, boost::memory_order_relaxed);
+    rebuild_ns_.fetch_add(nanoseconds, boost::memory_order_relaxed);
+  }
+
+  std::uint32_t divisor() const {
+    return divisor_.load(boost::memory_order_relaxed);
+  }
+
+private:
+  //only written by the owning thread, so they do not need read-modify-write operations
+  struct alignas(64) Counters {
+    boost::atomic<std::uint64_t> reads = 0;
+    boost::atomic<std::uint64_t> writes = 0;
+  };
+
+  std::vector<Counters> counters_;
+  boost::atomic<std::uint32_t> divisor_ = kMinDivisor;
+  boost::atomic<std::uint64_t> rebuilt_nodes_ = 0;
+  boost::atomic<std::uint64_t> rebuild_ns_ = 0;
+
+  boost::atomic<bool> updating_ = false;
+  std::uint64_t last_reads_ = 0;
+  std::uint64_t last_writes_ = 0;
+
+  void count(boost::atomic<std::uint64_t>& counter, const boost::atomic<std::uint64_t>& other) {
+    std::uint64_t n = counter.load(boost::memory_order_relaxed) + 1;
+    counter.store(n, boost::memory_order_relaxed);
+    if ((n + other.load(boost::memory_order_relaxed)) % kWindow == 0)
+      update_divisor();
+  }
+
+  void update_divisor() {
+    if (updating_.exchange(true, boost::memory_order_acquire))
+      return;
+
+    std::uint64_t reads = 0;
+    std::uint64_t writes = 0;
+    for (const Counters& c : counters_) {
+      reads += c.reads.load(boost::memory_order_relaxed);
+      writes += c.writes.load(boost::memory_order_relaxed);
+    }
+    const double window_reads = static_cast<double>(reads - last_reads_);
+    const double window_writes = static_cast<double>(writes - last_writes_);
+    last_reads_ = reads;
+    last_writes_ = writes;
+
+    const std::uint64_t nodes = rebuilt_nodes_.load(boost::memory_order_relaxed);
+    const double ns_per_node = nodes == 0 ? kCheapNodeNs : static_cast<double>(rebuild_ns_.load(boost::memory_order_relaxed)) / static_cast<double>(nodes);
+    const double cheapness = std::clamp(kCheapNodeNs / std::max(ns_per_node, 1.0), 0.5, 2.0);
+
+    const double divisor = kMinDivisor * (window_reads + 1) / (window_writes + 1) * cheapness;
+    divisor_.store(static_cast<std::uint32_t>(std::clamp(divisor, static_cast<double>(kMinDivisor), static_cast<double>(kMaxDivisor))), boost::memory_order_relaxed);
+
+    updating_.store(false, boost::memory_order_release);
+  }
+};
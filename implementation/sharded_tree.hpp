@@ -0,0 +1,108 @@
+#pragma once
+
+#include "concurrent_tree.hpp"
+#include "parallel_sort.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Splits the key space into ranges that are each stored in their own ConcurrentTree, so operations on different ranges
+ * do not share a root queue and its timestamp counter
+ * Shard i holds the values in [boundaries[i-1], boundaries[i]), the first and the last shard are open towards the smaller and larger values.
+ * Inserts, removes and lookups go to a single shard and are linearizable like in ConcurrentTree.
+ * range_count asks every shard that overlaps the interval and sums the results. The count of every shard is linearizable on its own,
+ * but the shards are counted one after another, so the sum is not a snapshot of the whole tree:
+ * values that are part of the tree during the whole query are always counted, values that are inserted or removed concurrently may or may not be.
+ */
+template <class T, bool rebuild_b = true, class RebuildPolicy = DefaultRebuildPolicy, std::size_t MaxThreads = 0>
+class ShardedConcurrentTree {
+public:
+  using Shard = ConcurrentTree<T, rebuild_b, RebuildPolicy, MaxThreads>;
+
+  /**
+   * Creates an empty tree with boundaries.size()+1 shards that allows concurrent access by max_threads threads
+   * Throws std::invalid_argument if boundaries is not strictly ascending
+   */
+  ShardedConcurrentTree(std::vector<T> boundaries, std::size_t max_threads, TreeOptions options = {}) : boundaries_(std::move(boundaries)) {
+    if (std::adjacent_find(boundaries_.begin(), boundaries_.end(), [](const T& a, const T& b) { return !(a < b); }) != boundaries_.end())
+      throw std::invalid_argument("Shard boundaries have to be strictly ascending");
+    for (std::size_t i = 0; i <= boundaries_.size(); ++i) {
+      shards_.push_back(std::make_unique<Shard>(max_threads, options));
+    }
+  }
+
+  /**
+   * Creates a tree with up to num_shards shards that allows concurrent access by max_threads threads
+   * The tree will contain the values in the initial_values vector, the boundaries are chosen so every shard gets about the same number of them
+   */
+  ShardedConcurrentTree(std::vector<T> initial_values, std::size_t num_shards, std::size_t max_threads, TreeOptions options = {}) {
+    parallel_sort(std::span<T>(initial_values), options.build_threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options.build_threads);
+    for (std::size_t i = 1; i < num_shards && initial_values.size() >= num_shards; ++i) {
+      //duplicates would lead to empty shards
+      const T& boundary = initial_values[initial_values.size() * i / num_shards];
+      if (boundaries_.empty() || boundaries_.back() < boundary)
+        boundaries_.push_back(boundary);
+    }
+    std::span<const T> values(initial_values);
+    auto begin = values.begin();
+    for (std::size_t i = 0; i <= boundaries_.size(); ++i) {
+      auto end = i < boundaries_.size() ? std::lower_bound(begin, values.end(), boundaries_[i]) : values.end();
+      shards_.push_back(std::make_unique<Shard>(std::span<const T>(begin, end), max_threads, options));
+      begin = end;
+    }
+  }
+
+  /*
+   * Inserts a value into the tree, see ConcurrentTree::insert
+   */
+  bool insert(const T value, const std::size_t tid) {
+    return shards_[shard_of(value)]->insert(value, tid);
+  }
+
+  /*
+   * Removes a value from the tree, see ConcurrentTree::remove
+   */
+  void remove(const T value, const std::size_t tid) {
+    shards_[shard_of(value)]->remove(value, tid);
+  }
+
+  /**
+   * Returns true if value is part of the tree, false if it is not
+   */
+  [[nodiscard]] bool lookup(const T value, const std::size_t tid) {
+    return shards_[shard_of(value)]->lookup(value, tid);
+  }
+
+  /**
+   * Returns the number of elements of the closed interval [lower, upper] that are part of the tree
+   * See the class comment for the guarantees if the interval spans more than one shard
+   */
+  [[nodiscard]] std::uint32_t range_count(const T lower, const T upper, const std::size_t tid) {
+    std::uint32_t result = 0;
+    //every shard only holds its own values, so all of them can be asked for the whole interval
+    for (std::size_t i = shard_of(lower); i <= shard_of(upper); ++i) {
+      result += shards_[i]->range_count(lower, upper, tid);
+    }
+    return result;
+  }
+
+  std::size_t num_shards() const {
+    return shards_.size();
+  }
+
+private:
+  std::vector<T> boundaries_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  /**
+   * Index of the shard value belongs to
+   */
+  std::size_t shard_of(const T& value) const {
+    return static_cast<std::size_t>(std::upper_bound(boundaries_.begin(), boundaries_.end(), value) - boundaries_.begin());
+  }
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Header of a snapshot file, followed by count keys of key_size bytes in ascending order
+ * The header is padded to 64 bytes, so the keys are suitably aligned for every key type when the file is mapped
+ */
+struct alignas(64) SnapshotHeader {
+  static constexpr char kMagic[8] = {'W', 'F', 'T', 'R', 'E', 'E', 'S', 'N'};
+  static constexpr std::uint32_t kVersion = 1;
+
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t key_size;
+  std::uint64_t count;
+};
+
+/**
+ * Writes keys (which have to be sorted) as a snapshot file to path
+ * Throws std::system_error if the file can not be written
+ */
+template <class T>
+void write_snapshot(const std::string& path, std::span<const T> keys) {
+  static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable keys can be written to a snapshot");
+
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), "Could not open snapshot " + path);
+
+  SnapshotHeader header{};
+  std::memcpy(header.magic, SnapshotHeader::kMagic, sizeof(header.magic));
+  header.version = SnapshotHeader::kVersion;
+  header.key_size = sizeof(T);
+  header.count = keys.size();
+
+  auto write_all = [&](const char* data, std::size_t size) {
+    while (size > 0) {
+      ssize_t written = ::write(fd, data, size);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "Could not write snapshot " + path);
+      }
+      data += written;
+      size -= static_cast<std::size_t>(written);
+    }
+  };
+  write_all(reinterpret_cast<const char*>(&header), sizeof(header));
+  write_all(reinterpret_cast<const char*>(keys.data()), keys.size_bytes());
+
+  if (::close(fd) != 0)
+    throw std::system_error(errno, std::generic_category(), "Could not close snapshot " + path);
+}
+
+/**
+ * Read-only memory mapping of a snapshot file
+ * The keys are only valid as long as this object exists
+ */
+template <class T>
+class MappedSnapshot {
+public:
+  explicit MappedSnapshot(const std::string& path) {
+    static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable keys can be read from a snapshot");
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::system_error(errno, std::generic_category(), "Could not open snapshot " + path);
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      int err = errno;
+      ::close(fd);
+      throw std::system_error(err, std::generic_category(), "Could not stat snapshot " + path);
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ < sizeof(SnapshotHeader)) {
+      ::close(fd);
+      throw std::runtime_error("Snapshot " + path + " is too small");
+    }
+
+    data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (data_ == MAP_FAILED)
+      throw std::system_error(errno, std::generic_category(), "Could not map snapshot " + path);
+
+    const SnapshotHeader* header = static_cast<const SnapshotHeader*>(data_);
+    if (std::memcmp(header->magic, SnapshotHeader::kMagic, sizeof(header->magic)) != 0 || header->version != SnapshotHeader::kVersion || header->key_size != sizeof(T) || header->count > (size_ - sizeof(SnapshotHeader)) / sizeof(T)) {
+      ::munmap(data_, size_);
+      throw std::runtime_error("Snapshot " + path + " is invalid or was written for a different key type");
+    }
+    keys_ = std::span<const T>(reinterpret_cast<const T*>(static_cast<const char*>(data_) + sizeof(SnapshotHeader)), header->count);
+  }
+
+  MappedSnapshot(const MappedSnapshot&) = delete;
+  MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+  ~MappedSnapshot() {
+    ::munmap(data_, size_);
+  }
+
+  std::span<const T> keys() const {
+    return keys_;
+  }
+
+private:
+  void* data_ = nullptr;
+  std::size_t size_ = 0;
+  std::span<const T> keys_;
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Out-of-line part of a StringKey, the characters after the inline prefix follow directly after this header
+ */
+struct StringSuffix {
+  std::uint32_t size;
+
+  const char* data() const {
+    return reinterpret_cast<const char*>(this + 1);
+  }
+};
+
+/**
+ * Trivially copyable key type for variable-length strings, so they can be used as T in ConcurrentTree
+ * The first kPrefixSize characters are stored inline as a big-endian integer, so most comparisons are decided by a single integer comparison.
+ * The remaining characters of longer strings live in a StringArena, which has to outlive every tree that contains the key.
+ * Strings must not contain '\0' characters, as the prefix is padded with zeros.
+ * StringKey{} (the empty string) is the sentinel of the tree and can therefore not be inserted.
+ */
+struct StringKey {
+  static constexpr std::size_t kPrefixSize = sizeof(std::uint64_t);
+
+  std::uint64_t prefix = 0;
+  const StringSuffix* suffix = nullptr;
+
+  /**
+   * Packs the first kPrefixSize characters of str so that integer comparison equals lexicographic comparison
+   */
+  static std::uint64_t make_prefix(std::string_view str) {
+    std::uint64_t p = 0;
+    std::size_t n = std::min(str.size(), kPrefixSize);
+    for (std::size_t i = 0; i < kPrefixSize; ++i) {
+      p <<= 8;
+      if (i < n)
+        p |= static_cast<unsigned char>(str[i]);
+    }
+    return p;
+  }
+
+  std::size_t size() const {
+    if (suffix != nullptr)
+      return kPrefixSize + suffix->size;
+    std::size_t n = 0;
+    while (n < kPrefixSize && ((prefix >> (8 * (kPrefixSize - 1 - n))) & 0xff) != 0)
+      ++n;
+    return n;
+  }
+
+  std::string to_string() const {
+    std::string s;
+    s.reserve(size());
+    for (std::size_t i = 0; i < kPrefixSize; ++i) {
+      char c = static_cast<char>((prefix >> (8 * (kPrefixSize - 1 - i))) & 0xff);
+      if (c == '\0')
+        break;
+      s.push_back(c);
+    }
+    if (suffix != nullptr)
+      s.append(suffix->data(), suffix->size);
+    return s;
+  }
+
+  friend bool operator==(const StringKey& lhs, const StringKey& rhs) {
+    if (lhs.prefix != rhs.prefix)
+      return false;
+    if (lhs.suffix == rhs.suffix)
+      return true;
+    if (lhs.suffix == nullptr || rhs.suffix == nullptr)
+      return false;
+    return lhs.suffix->size == rhs.suffix->size && std::memcmp(lhs.suffix->data(), rhs.suffix->data(), lhs.suffix->size) == 0;
+  }
+
+  friend std::strong_ordering operator<=>(const StringKey& lhs, const StringKey& rhs) {
+    //common case, decided by the inline prefix
+    if (lhs.prefix != rhs.prefix)
+      return lhs.prefix <=> rhs.prefix;
+    if (lhs.suffix == rhs.suffix)
+      return std::strong_ordering::equal;
+    //a string without suffix is a prefix of the other one
+    if (lhs.suffix == nullptr)
+      return std::strong_ordering::less;
+    if (rhs.suffix == nullptr)
+      return std::strong_ordering::greater;
+
+    std::uint32_t common = std::min(lhs.suffix->size, rhs.suffix->size);
+    int cmp = std::memcmp(lhs.suffix->data(), rhs.suffix->data(), common);
+    if (cmp != 0)
+      return cmp <=> 0;
+    return lhs.suffix->size <=> rhs.suffix->size;
+  }
+};
+
+/**
+ * Append-only storage for the suffixes of StringKeys
+ * Memory is allocated in chunks and only released when the arena is destroyed.
+ * The arena is not thread-safe, use one arena per thread or synchronize externally.
+ */
+class StringArena {
+public:
+  explicit StringArena(std::size_t chunk_size = 1 << 20) : chunk_size_(chunk_size) {}
+
+  /**
+   * Creates a key for str, copying the characters that do not fit into the prefix into the arena
+   */
+  StringKey make(std::string_view str) {
+    StringKey key;
+    key.prefix = StringKey::make_prefix(str);
+    if (str.size() > StringKey::kPrefixSize) {
+      std::string_view rest = str.substr(StringKey::kPrefixSize);
+      StringSuffix* s = allocate(rest.size());
+      s->size = static_cast<std::uint32_t>(rest.size());
+      std::memcpy(const_cast<char*>(s->data()), rest.data(), rest.size());
+      key.suffix = s;
+    }
+    return key;
+  }
+
+  /**
+   * Number of bytes used by suffixes, including headers and alignment
+   */
+  std::size_t bytes_used() const {
+    return bytes_used_;
+  }
+
+private:
+  const std::size_t chunk_size_;
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  std::size_t offset_ = 0;
+  std::size_t capacity_ = 0;
+  std::size_t bytes_used_ = 0;
+
+  StringSuffix* allocate(std::size_t chars) {
+    constexpr std::size_t align = alignof(StringSuffix);
+    std::size_t needed = (sizeof(StringSuffix) + chars + align - 1) & ~(align - 1);
+    if (chunks_.empty() || offset_ + needed > capacity_) {
+      capacity_ = std::max(chunk_size_, needed);
+      chunks_.emplace_back(new char[capacity_]);
+      offset_ = 0;
+    }
+    char* p = chunks_.back().get() + offset_;
+    offset_ += needed;
+    bytes_used_ += needed;
+    return new (p) StringSuffix{};
+  }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Storage of a single thread, with Padded on its own cache line, so writes of neighbouring threads do not invalidate it
+ */
+template <class V, bool Padded>
+struct alignas(Padded ? 64 : alignof(V)) ThreadSlot {
+  V value{};
+};
+
+/**
+ * One value per thread id, used for the announcement arrays and hazard pointers of the queues and the tree
+ * With MaxThreads = 0 the number of threads is only known at runtime and the values are stored in a vector.
+ * Otherwise they are stored inline and size() is a compile-time constant, so loops over all threads have a fixed trip count.
+ * Padded puts every value on its own cache line. Structures that exist once per node or operation turn it off,
+ * because they are only contended at the top of the tree and the padding would multiply their size.
+ */
+template <class V, std::size_t MaxThreads = 0, bool Padded = true>
+class ThreadSlots {
+public:
+  explicit ThreadSlots(std::size_t num_threads) : slots_(num_threads) {}
+
+  V& operator[](std::size_t i) {
+    return slots_[i].value;
+  }
+
+  const V& operator[](std::size_t i) const {
+    return slots_[i].value;
+  }
+
+  std::size_t size() const {
+    return slots_.size();
+  }
+
+private:
+  std::vector<ThreadSlot<V, Padded>> slots_;
+};
+
+template <class V, std::size_t MaxThreads, bool Padded>
+  requires (MaxThreads > 0)
+class ThreadSlots<V, MaxThreads, Padded> {
+public:
+  /**
+   * Throws std::invalid_argument if num_threads is larger than MaxThreads
+   */
+  explicit ThreadSlots(std::size_t num_threads) {
+    if (num_threads > MaxThreads)
+      throw std::invalid_argument("More threads than MaxThreads");
+  }
+
+  V& operator[](std::size_t i) {
+    return slots_[i].value;
+  }
+
+  const V& operator[](std::size_t i) const {
+    return slots_[i].value;
+  }
+
+  static constexpr std::size_t size() {
+    return MaxThreads;
+  }
+
+private:
+  std::array<ThreadSlot<V, Padded>, MaxThreads> slots_;
+};
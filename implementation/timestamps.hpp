@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+/**
+ * Where the tree and its queues take the timestamps of operations from
+ */
+enum class TimestampSource : std::uint8_t {
+  // a shared counter that every operation increments, so its cache line moves between all cores
+  kCounter,
+  // the invariant TSC of x86 cpus with the thread id in the lowest bits, no shared cache line is written
+  // requires a TSC that is synchronized between all cores, which the kernel checks at boot (constant_tsc and nonstop_tsc)
+  kTsc,
+};
+
+// bits below the TSC that hold the thread id, so timestamps of different threads never collide
+inline constexpr int kTscTidBits = 6;
+
+/**
+ * Returns true if the cpu has an invariant TSC
+ */
+inline bool invariant_tsc_supported() {
+#if defined(__x86_64__)
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+    return false;
+  __cpuid(0x80000007, eax, ebx, ecx, edx);
+  return (edx & (1u << 8)) != 0;
+#else
+  return false;
+#endif
+}
+
+/**
+ * Returns a timestamp that is larger than every timestamp any thread got before the call started
+ * The mfence orders the read after the stores of the caller (the announcement of the operation), like the locked add of a counter,
+ * and the lfence keeps later loads from being executed before the TSC was read
+ * The TSC is shifted by kTscTidBits, which keeps the timestamps below 2^62 for centuries of uptime
+ */
+inline std::uint64_t tsc_timestamp(std::size_t tid) {
+#if defined(__x86_64__)
+  unsigned int aux;
+  _mm_mfence();
+  const std::uint64_t tsc = __rdtscp(&aux);
+  _mm_lfence();
+  return (tsc << kTscTidBits) | tid;
+#else
+  static_cast<void>(tid);
+  return 0;
+#endif
+}
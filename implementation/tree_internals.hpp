@@ -3,16 +3,26 @@
 #include "waitfree_queue.hpp"
 #include "tuple_queue.hpp"
 #include "conditional_q.hpp"
+#include "leaf_block.hpp"
+#include "timestamps.hpp"
 
+#include <algorithm>
 #include <cstdint>
 #include <limits>
+#include <memory>
+#include <new>
+#include <span>
 #include <unordered_map>
+#include <vector>
 
 #include <boost/atomic/atomic.hpp>
 
-template <class T>
+template <class T, std::size_t MaxThreads = 0>
 struct Node;
 
+template <class T, std::size_t MaxThreads = 0>
+struct RebuildDescriptor;
+
 enum OperationType {
   kInsert,
   kRemove,
@@ -20,19 +30,58 @@ enum OperationType {
   kRangeCount,
 };
 
-template <class T>
+template <class T, std::size_t MaxThreads = 0>
+struct RangeOperation;
+
+/**
+ * An insert, remove or lookup, which only follows the path to its value
+ * Range counts are RangeOperations, which add the state to combine the counts of their paths, the type tells which one it is
+ */
+template <class T, std::size_t MaxThreads = 0>
 struct Operation {
   const OperationType type;
   boost::atomic<std::uint64_t> timestamp = 0;
-  TupleQueue<Node<T>*, std::uint32_t> to_visit;
+  // not padded, every operation has its own and other threads only push to it while helping
+  TupleQueue<Node<T, MaxThreads>*, std::uint32_t, MaxThreads, false> to_visit;
   const T value = T{};
+  boost::atomic<bool> success = false;
+  // set after success, if the operation was completed at the root without passing it down (see ConcurrentTree::eliminate_at_root)
+  boost::atomic<bool> done_at_root = false;
+
+  Operation(std::size_t max_threads, OperationType init_type, const T init_value) :  type(init_type), to_visit(max_threads), value(init_value) {}
+
+  // range counts are destroyed as RangeOperation, so every operation can be deleted through a pointer to Operation without a vtable
+  void operator delete(Operation* op, std::destroying_delete_t) {
+    if (op->type == OperationType::kRangeCount) {
+      auto range_op = static_cast<RangeOperation<T, MaxThreads>*>(op);
+      std::destroy_at(range_op);
+      deallocate(range_op);
+    } else {
+      std::destroy_at(op);
+      deallocate(op);
+    }
+  }
+
+  template <class Op>
+  static void deallocate(Op* op) {
+    if constexpr (alignof(Op) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+      ::operator delete(op, std::align_val_t{alignof(Op)});
+    else
+      ::operator delete(op);
+  }
+};
+
+/**
+ * A range count of the closed interval [value, value2]
+ */
+template <class T, std::size_t MaxThreads>
+struct RangeOperation : Operation<T, MaxThreads> {
   const T value2 = T{};
   boost::atomic<T> split = T{};
   boost::atomic<std::uint32_t> lower_count = 0;
   boost::atomic<std::uint32_t> upper_count = 0;
-  boost::atomic<bool> success = false;
 
-  Operation(std::size_t max_threads, OperationType init_type, const T init_value, const T init_value2 = T{}) :  type(init_type), to_visit(max_threads), value(init_value), value2(init_value2) {}
+  RangeOperation(std::size_t max_threads, const T lower, const T upper) : Operation<T, MaxThreads>(max_threads, OperationType::kRangeCount, lower), value2(upper) {}
 };
 
 struct NodeState {
@@ -53,25 +102,249 @@ struct NodeState {
   }
 };
 
-template <class T>
+/**
+ * One allocation for all nodes of a subtree that is built at once (see TreeOptions::veb_layout)
+ * The nodes are constructed in place and still deleted one by one, the memory is freed with the last one
+ */
+struct NodeArena {
+  void* memory;
+  const std::size_t node_size;
+  const std::align_val_t alignment;
+  boost::atomic<std::size_t> live;
+
+  NodeArena(std::size_t num_nodes, std::size_t init_node_size, std::size_t init_alignment) : node_size(init_node_size), alignment(std::align_val_t{std::max<std::size_t>(init_alignment, 64)}), live(num_nodes) {
+    memory = ::operator new(num_nodes * node_size, alignment);
+  }
+
+  void* slot(std::size_t i) {
+    return static_cast<char*>(memory) + i * node_size;
+  }
+
+  /**
+   * Called for every destroyed node, the last one frees the arena
+   */
+  void release() {
+    if (live.fetch_sub(1, boost::memory_order_acq_rel) == 1) {
+      ::operator delete(memory, alignment);
+      delete this;
+    }
+  }
+};
+
+template <class T, std::size_t MaxThreads>
 struct Node {
   boost::atomic<NodeState> state;
-  ConditionalQ<Operation<T>> ops;
-  const std::uint64_t init_size;
-  const T value;
-  boost::atomic<Node<T> *> left_child = nullptr;
-  boost::atomic<Node<T> *> right_child = nullptr;
-
-  Node(std::size_t max_threads, const std::uint64_t init_init_size, const T init_value, NodeState initial_state) : state(initial_state), ops(max_threads), init_size(init_init_size), value(init_value) {}
-  ~Node() {}
+  // not padded, only the queues at the top of the tree are contended and padding would more than double the size of a node
+  ConditionalQ<Operation<T, MaxThreads>, MaxThreads, false> ops;
+  // only changes when a subtree is relinked by split_at or merge, which do not run concurrently with other operations
+  std::uint64_t init_size;
+  // only changes when a retired node is recycled by a rebuild
+  T value;
+  boost::atomic<Node<T, MaxThreads> *> left_child = nullptr;
+  boost::atomic<Node<T, MaxThreads> *> right_child = nullptr;
+  // shared state of a cooperative rebuild of the subtree rooted at this node
+  boost::atomic<RebuildDescriptor<T, MaxThreads> *> rebuild = nullptr;
+  // keys of a fat leaf besides value, only set by rebuilds and never changed afterwards
+  LeafBlock<T>* block = nullptr;
+  // allocation the node was constructed in, nullptr if it was allocated on its own
+  NodeArena* arena = nullptr;
+
+  // operations that are not newer than the initial state already passed the position of the node, so the queue does not accept them
+  // otherwise a thread that lags behind could push an operation that is completed already
+  Node(std::size_t max_threads, TimestampSource timestamps, const std::uint64_t init_init_size, const T init_value, NodeState initial_state) : state(initial_state), ops(max_threads, initial_state.get_last_timestamp(), timestamps), init_size(init_init_size), value(init_value) {}
+  ~Node() {
+    delete rebuild.load();
+    delete block;
+  }
+
+  // nodes of an arena return their memory to it, so every node can be deleted the same way
+  void operator delete(Node* n, std::destroying_delete_t) {
+    NodeArena* node_arena = n->arena;
+    n->~Node();
+    if (node_arena != nullptr)
+      node_arena->release();
+    else if constexpr (alignof(Node) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+      ::operator delete(n, std::align_val_t{alignof(Node)});
+    else
+      ::operator delete(n);
+  }
 };
 
-template <class T>
+/**
+ * Shared state of a rebuild of the subtree rooted at a node, so every thread that wants to rebuild the same subtree can help
+ * The work is split into chunks, which are claimed with a counter. A thread that runs out of unclaimed chunks redoes
+ * the ones that are still unfinished, and the first published result of a chunk is used, so no thread waits for another one.
+ * 1. The values of the old subtree are split into key ranges by bounds, the values of every range are finished and collected as a chunk
+ * 2. The collected values are split into ranges, the subtrees for these ranges are built as chunks and linked by a few top nodes
+ */
+template <class T, std::size_t MaxThreads>
+struct RebuildDescriptor {
+  // subtree of the new tree for the values [left:right+1] (in python notation)
+  struct BuildTask {
+    std::size_t left;
+    std::size_t right;
+  };
+
+  // sorted values of the new subtree, split into the collected pieces and the tasks to build it
+  struct BuildPlan {
+    std::vector<std::span<const T>> pieces;
+    std::vector<std::size_t> offsets;
+    std::size_t size = 0;
+    std::size_t depth = 0;
+    std::vector<BuildTask> tasks;
+    std::unique_ptr<boost::atomic<Node<T, MaxThreads>*>[]> built;
+    boost::atomic<std::size_t> next_task = 0;
+
+    const T& operator[](std::size_t i) const {
+      std::size_t piece = static_cast<std::size_t>(std::upper_bound(offsets.begin(), offsets.end(), i) - offsets.begin()) - 1;
+      return pieces[piece][i - offsets[piece]];
+    }
+  };
+
+  // update operation that passed the parent of the subtree after the rebuild started (only used by incremental rebuilds)
+  struct LogEntry {
+    bool insert;
+    T value;
+    std::uint64_t timestamp;
+    LogEntry* next;
+  };
+  // timestamp of the entry that seals the log, no entries can be added afterwards
+  static constexpr std::uint64_t kSealed = std::numeric_limits<std::uint64_t>::max();
+
+  const std::uint64_t timestamp;
+  // chunk i collects the values in [bounds[i-1], bounds[i])
+  std::vector<T> bounds;
+  std::unique_ptr<boost::atomic<std::vector<T>*>[]> collected;
+  boost::atomic<std::size_t> next_chunk = 0;
+  boost::atomic<BuildPlan*> plan = nullptr;
+  boost::atomic<Node<T, MaxThreads>*> result = nullptr;
+  boost::atomic<bool> finished = false;
+
+  // result with the log replayed, nodes of result on the replayed paths were copied and are kept in replaced
+  boost::atomic<LogEntry*> log = nullptr;
+  boost::atomic<Node<T, MaxThreads>*> installed = nullptr;
+  boost::atomic<std::vector<Node<T, MaxThreads>*>*> replaced = nullptr;
+  boost::atomic<bool> replayed = false;
+
+  // the new subtree replaced the old one in the tree, so it is no longer owned by this descriptor
+  boost::atomic<bool> linked = false;
+
+  // a background worker was asked to finish the rebuild (RebuildMode::kBackground)
+  boost::atomic<bool> requested = false;
+
+  // the thread that published the descriptor checked afterwards that no newer update reached the subtree before,
+  // otherwise the rebuild is abandoned and never linked, see ConcurrentTree::get_rebuild_descriptor
+  boost::atomic<bool> confirmed = false;
+  boost::atomic<bool> abandoned = false;
+  // abandoned descriptor of the same node that was replaced by this one, it is deleted together with this one
+  RebuildDescriptor* previous = nullptr;
+
+  explicit RebuildDescriptor(std::uint64_t init_timestamp) : timestamp(init_timestamp) {}
+
+  std::size_t num_chunks() const {
+    return bounds.size() + 1;
+  }
+
+  ~RebuildDescriptor() {
+    if (!linked.load()) {
+      //free the parts of the new subtree that were built already
+      if (replayed.load()) {
+        delete_subtree(installed.load());
+      } else if (finished.load()) {
+        delete_subtree(result.load());
+      } else if (plan.load() != nullptr) {
+        for (std::size_t i = 0; i < plan.load()->tasks.size(); ++i) {
+          delete_subtree(plan.load()->built[i].load());
+        }
+      }
+    }
+    if (replaced.load() != nullptr) {
+      for (Node<T, MaxThreads>* n : *replaced.load()) {
+        delete n;
+      }
+      delete replaced.load();
+    }
+    LogEntry* entry = log.load();
+    while (entry != nullptr) {
+      LogEntry* next = entry->next;
+      delete entry;
+      entry = next;
+    }
+    for (std::size_t i = 0; collected && i < num_chunks(); ++i) {
+      delete collected[i].load();
+    }
+    delete plan.load();
+    delete previous;
+  }
+
+  static void delete_subtree(Node<T, MaxThreads>* root) {
+    std::vector<Node<T, MaxThreads>*> stack;
+    if (root != nullptr)
+      stack.push_back(root);
+    while (!stack.empty()) {
+      Node<T, MaxThreads>* n = stack.back();
+      stack.pop_back();
+      if (n->left_child.load() != nullptr)
+        stack.push_back(n->left_child.load());
+      if (n->right_child.load() != nullptr)
+        stack.push_back(n->right_child.load());
+      delete n;
+    }
+  }
+};
+
+template <class T, std::size_t MaxThreads = 0>
 struct NodeRemoveFlags {
   std::uint64_t remove_flags = 0;
-  Node<T>* node;
+  Node<T, MaxThreads>* node;
 
-  friend bool operator==(const NodeRemoveFlags<T>& lhs, const NodeRemoveFlags<T>& rhs) {
+  friend bool operator==(const NodeRemoveFlags<T, MaxThreads>& lhs, const NodeRemoveFlags<T, MaxThreads>& rhs) {
     return lhs.node == rhs.node && lhs.remove_flags == rhs.remove_flags;
   }
-};
\ No newline at end of file
+};
+
+/**
+ * How subtrees with at least TreeOptions::cooperative_rebuild_min_size nodes are rebuilt
+ */
+enum class RebuildMode {
+  // the operation that triggers the rebuild (and every other operation reaching the subtree) helps until the new subtree is linked
+  kInline,
+  // every operation passing the parent of the subtree does a few chunks of the rebuild and continues in the old subtree,
+  // updates passing it are logged and replayed on the new subtree before it is linked
+  kIncremental,
+  // like kIncremental, but the rebuild is done by TreeOptions::background_threads dedicated threads and passing operations only log updates
+  kBackground,
+};
+
+/**
+ * Runtime configuration of a ConcurrentTree
+ */
+struct TreeOptions {
+  // number of threads used to sort and build the initial tree, 0 uses std::thread::hardware_concurrency()
+  std::size_t build_threads = 0;
+  // subtrees with at least this many nodes are rebuilt cooperatively by all threads that reach them, smaller ones by every thread on its own
+  std::size_t cooperative_rebuild_min_size = 1 << 12;
+  RebuildMode rebuild_mode = RebuildMode::kInline;
+  // approximate number of nodes per chunk of an incremental rebuild
+  std::size_t incremental_chunk_size = 1 << 10;
+  // number of chunks of an incremental rebuild every passing operation does
+  std::size_t incremental_budget = 1;
+  // number of threads that rebuild subtrees with RebuildMode::kBackground, they use the thread ids after the ones passed to the tree
+  std::size_t background_threads = 1;
+  // maximum number of retired nodes every thread keeps to reuse them in rebuilds, 0 frees all retired nodes
+  std::size_t node_pool_size = 1 << 16;
+  // rebuilds turn subtrees of up to leaf_block_size+1 values into a single node with the other values in a LeafBlock (at most 64), 0 disables fat leaves
+  // only supported with RebuildMode::kInline, trees with fat leaves can not be split or merged
+  std::size_t leaf_block_size = 0;
+  // rebuilds place the nodes of every new subtree in one allocation in van Emde Boas order, so the upper levels of a search path share pages
+  // and every subtree of a few levels is contiguous, retired nodes are not recycled then (node_pool_size is ignored)
+  bool veb_layout = false;
+  // operations whose result is known from their direct neighbour in timestamp order are completed at the root, see ConcurrentTree::eliminate_at_root
+  bool root_elimination = true;
+  // lookups and range counts read the tree directly while no other operation is in flight, see ConcurrentTree::read_uncontended
+  bool uncontended_reads = true;
+  // TimestampSource::kTsc takes the timestamps of operations and of the queues from the TSC instead of shared counters,
+  // it disables uncontended_reads, which detect other operations by the counter, and root_elimination rarely finds neighbours with it
+  // the constructor throws std::invalid_argument if the cpu has no invariant TSC
+  TimestampSource timestamp_source = TimestampSource::kCounter;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "implementation/conditional_hazard_pointers.hpp"
+#include "implementation/thread_slots.hpp"
 
 #include <memory>
 #include <iostream>
@@ -14,8 +15,10 @@
  * Same implementation details are taken from a blog post (http://concurrencyfreaks.blogspot.com/2016/12/a-c-implementation-of-kogan-petrank.html)
  * One major difference to the implementation in the blog post is the use of atomics for the operation description.
  * Even though OpDesc is 128bit and modern CPUs support 128bit atomics I didnt get them to work with gcc.
+ * With MaxThreads > 0 the announcements and hazard pointers of the threads are stored inline (see ThreadSlots).
+ * Padded puts the announcement and hazard pointers of every thread on their own cache lines.
  */
-template <class T>
+template <class T, std::size_t MaxThreads = 0, bool Padded = true>
 class WaitFreeQueue {
 private:
   struct Node {
@@ -56,13 +59,13 @@ private:
   boost::atomic<pNode> head;
   boost::atomic<pNode> tail;
 
-  ConditionalHazardPointers<Node, T> hp;
+  ConditionalHazardPointers<Node, T, MaxThreads, (MaxThreads > 0 ? 3 : 0), Padded> hp;
 
   static constexpr int kHpTail = 0;
   static constexpr int kHpHead = 1;
   static constexpr int kHpNext = 2;
 
-  std::vector<boost::atomic<OpDesc>> opdescs_;
+  ThreadSlots<boost::atomic<OpDesc>, MaxThreads, Padded> opdescs_;
   boost::atomic<std::uint64_t> next_timestamp_ = 1;
 
   bool isStillPending(const std::size_t i, const std::uint64_t timestamp) const {
@@ -71,7 +74,7 @@ private:
   }
 
   void help(std::uint64_t timestamp, std::size_t tid) {
-    for (std::size_t i = 0; i < max_threads_; ++i) {
+    for (std::size_t i = 0; i < opdescs_.size(); ++i) {
       OpDesc d = opdescs_[i].load();
       if (d.get_type() != OpType::kNotPending && d.get_timestamp() <= timestamp) {
         if (d.get_type() == OpType::kPush) {
@@ -193,34 +196,36 @@ private:
   }
 
 public:
-  WaitFreeQueue(std::size_t max_threads) : max_threads_(max_threads), hp(3, max_threads), opdescs_(max_threads) {
+  WaitFreeQueue(std::size_t max_threads) : max_threads_(MaxThreads > 0 ? MaxThreads : max_threads), hp(3, max_threads), opdescs_(max_threads) {
+    //nothing is shared before the constructor returns, the thread that hands the queue to others publishes it
     pNode n = new Node;
-    n->next = nullptr;
+    n->next.store(nullptr, boost::memory_order_relaxed);
     n->push_tid = 0;
-    n->pop_tid = max_threads_;
-    head.store(n);
-    tail.store(n);
+    n->pop_tid.store(max_threads_, boost::memory_order_relaxed);
+    head.store(n, boost::memory_order_relaxed);
+    tail.store(n, boost::memory_order_relaxed);
 
-    for (std::size_t i = 0; i < max_threads_; ++i) {
-      opdescs_[i].store({nullptr, 0, OpType::kNotPending});
+    for (std::size_t i = 0; i < opdescs_.size(); ++i) {
+      opdescs_[i].store({nullptr, 0, OpType::kNotPending}, boost::memory_order_relaxed);
     }
   }
 
   ~WaitFreeQueue() {
-    pNode n = head.load();
+    pNode n = head.load(boost::memory_order_relaxed);
     do {
-      pNode tmp = n->next.load();
+      pNode tmp = n->next.load(boost::memory_order_relaxed);
       delete n;
       n = tmp;
     } while (n != nullptr);
   }
 
   void push(T value, std::size_t tid) {
+    //the node is published by the seq_cst store of the announcement, which orders these stores before it
     pNode n = new Node;
-    n->next = nullptr;
+    n->next.store(nullptr, boost::memory_order_relaxed);
     n->push_tid = tid;
-    n->value = value;
-    n->pop_tid = max_threads_;
+    n->value.store(value, boost::memory_order_relaxed);
+    n->pop_tid.store(max_threads_, boost::memory_order_relaxed);
 
     std::uint64_t timestamp = next_timestamp_.fetch_add(1);
     OpDesc d(n, timestamp, OpType::kPush);
@@ -71,6 +71,7 @@ bool removal_test() {
     constexpr auto num_elements = 1'000'000;
 
     ConditionalQ<TestObj> queue(num_threads);
+    HazardPointers<TestObj> value_hp(1, num_threads);
     std::vector<TestObj*> objects;
     std::vector<std::atomic_char> seen(num_elements);
     for (int i = 1; i <= num_elements; ++i) {
@@ -88,7 +89,7 @@ bool removal_test() {
         for (auto i = 0u; i < num_threads; ++i) {
             threads.emplace_back([&, i] {
                 TestObj* a = nullptr;
-                while ((a = queue.peek(i)) != nullptr) {
+                while ((a = queue.peek_protected(value_hp, 0, i)) != nullptr) {
                     if (a->timestamp < 0 || a->timestamp > num_elements) {
                         std::cerr << "Error: Popped invalid value\n";
                         success = false;
@@ -151,10 +152,7 @@ void add_ops_to_root(ConditionalQ<TestObjA>& q, std::size_t max_threads_, std::s
     }
     std::sort(to_insert.begin(), to_insert.end(), [](TestObjA* a, TestObjA* b) {return a->timestamp < b->timestamp;});
 
-    for (auto a : to_insert) {
-    //   std::clog << "Inserting " << a->value << " with timestamp " << a->timestamp << std::endl;
-      q.push_if(a, tid);
-    }
+    q.push_if_batch(to_insert, tid);
   }
 
 bool root_input_test() {
@@ -222,6 +220,71 @@ bool root_input_test() {
     return true;
 }
 
+bool reset_test() {
+    std::vector<TestObj> data(10);
+    for (unsigned int i = 0; i < data.size(); ++i) {
+        data[i].timestamp = i + 1;
+    }
+    ConditionalQ<TestObj> queue(1, 5);
+
+    //values that are not newer than the minimum timestamp are rejected
+    queue.push_if(&data[3], 0);
+    queue.push_if(&data[4], 0);
+    if (queue.peek(0) != nullptr) {
+        std::clog << "Inserted value below the minimum timestamp\n";
+        return false;
+    }
+    queue.push_if(&data[5], 0);
+    queue.push_if(&data[6], 0);
+
+    queue.reset(1);
+    if (queue.peek(0) != nullptr) {
+        std::clog << "Queue not empty after reset\n";
+        return false;
+    }
+    queue.push_if(&data[1], 0);
+    if (queue.peek(0) != &data[1]) {
+        std::clog << "Reset did not lower the minimum timestamp\n";
+        return false;
+    }
+
+    std::clog << "Reset test successfull\n";
+    return true;
+}
+
+bool batch_test() {
+    std::vector<TestObj> data(10);
+    for (unsigned int i = 0; i < data.size(); ++i) {
+        data[i].timestamp = i + 1;
+    }
+    ConditionalQ<TestObj> queue(1);
+
+    queue.push_if(&data[2], 0);
+    //the values that are not newer than the tail are dropped, the rest is appended in order
+    std::vector<TestObj*> batch = {&data[0], &data[2], &data[3], &data[5]};
+    queue.push_if_batch(batch, 0);
+    //a batch that is completely older than the tail changes nothing
+    std::vector<TestObj*> old_batch = {&data[1], &data[4]};
+    queue.push_if_batch(old_batch, 0);
+    queue.push_if(&data[6], 0);
+
+    for (std::uint32_t expected : {3, 4, 6, 7}) {
+        TestObj* a = queue.peek(0);
+        if (a == nullptr || a->timestamp != expected) {
+            std::clog << "Batch test failed, expected " << expected << std::endl;
+            return false;
+        }
+        queue.pop_if(a->timestamp, 0);
+    }
+    if (queue.peek(0) != nullptr) {
+        std::clog << "Batch test failed, queue not empty" << std::endl;
+        return false;
+    }
+
+    std::clog << "Batch test successfull\n";
+    return true;
+}
+
 int main() {
-    return !root_input_test() || !input_test() || !removal_test();
+    return !root_input_test() || !input_test() || !removal_test() || !reset_test() || !batch_test();
 }
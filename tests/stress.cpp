@@ -0,0 +1,149 @@
+#include "implementation/concurrent_tree.hpp"
+#include "implementation/tuple_queue.hpp"
+#include "implementation/waitfree_queue.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//short runs with a fixed number of threads, so the tests stay fast enough for the asan, ubsan and tsan presets
+constexpr auto num_threads = 4u;
+
+/**
+ * Every thread inserts, removes and looks up random values of its own residue class and checks the results against a local set,
+ * while the other threads change the rest of the tree and count ranges over all of it
+ */
+bool tree_stress_test(const std::string& name, const TreeOptions& options) {
+  constexpr int num_values = 4096;
+  constexpr int ops_per_thread = 10000;
+
+  std::vector<int> data;
+  for (int i = 1; i <= num_values; i += 2)
+    data.push_back(i);
+  ConcurrentTree<int> tree(data, num_threads, options);
+
+  std::atomic_bool success = true;
+  std::vector<std::set<int>> expected(num_threads);
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (auto i = 0u; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        std::set<int>& own = expected[i];
+        for (int v : data) {
+          if (static_cast<unsigned int>(v) % num_threads == i)
+            own.insert(v);
+        }
+        std::mt19937 g(i + 1);
+        std::uniform_int_distribution<int> pick(0, num_values / num_threads - 1);
+        std::uniform_int_distribution<int> kind(0, 9);
+        for (int j = 0; j < ops_per_thread; ++j) {
+          int value = pick(g) * static_cast<int>(num_threads) + static_cast<int>(i);
+          if (value == 0)
+            value = static_cast<int>(num_threads);
+          int k = kind(g);
+          if (k < 3) {
+            if (!own.contains(value)) {
+              if (!tree.insert(value, i)) {
+                std::clog << "Failed to insert " << value << std::endl;
+                success = false;
+              }
+              own.insert(value);
+            }
+          } else if (k < 6) {
+            if (own.contains(value)) {
+              tree.remove(value, i);
+              own.erase(value);
+            }
+          } else if (k < 9) {
+            if (tree.lookup(value, i) != own.contains(value)) {
+              std::clog << "Wrong lookup result for " << value << std::endl;
+              success = false;
+            }
+          } else {
+            static_cast<void>(tree.range_count(1, num_values, i));
+          }
+        }
+      });
+    }
+  }
+
+  //range counts are only exact without removals, so the result is checked with lookups of every value
+  for (int v = 1; v <= num_values; ++v) {
+    if (tree.lookup(v, 0) != expected[static_cast<unsigned int>(v) % num_threads].contains(v)) {
+      std::clog << "Wrong lookup result for " << v << std::endl;
+      success = false;
+    }
+  }
+  std::clog << "Finished " << name << " stress Test\n";
+  return success;
+}
+
+/**
+ * Every thread pops a value and pushes a new one, every value has to be popped at most once
+ * The values of TupleQueue carry their own negation as second value
+ */
+template <class Queue>
+bool queue_stress_test(const std::string& name) {
+  constexpr int initial_size = 64;
+  constexpr int ops_per_thread = 20000;
+
+  Queue queue(num_threads);
+  auto push = [&](int v, std::size_t tid) {
+    if constexpr (std::is_same_v<Queue, TupleQueue<int, int>>)
+      queue.push(v, -v, tid);
+    else
+      queue.push(v, tid);
+  };
+  for (int i = 1; i <= initial_size; ++i)
+    push(i, 0);
+
+  std::vector<std::atomic_char> seen(initial_size + num_threads * ops_per_thread);
+  std::atomic_bool success = true;
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (auto i = 0u; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < ops_per_thread; ++j) {
+          int v;
+          if constexpr (std::is_same_v<Queue, TupleQueue<int, int>>) {
+            auto [first, second] = queue.pop(i);
+            if (first != -second) {
+              std::clog << "Torn value " << first << " " << second << std::endl;
+              success = false;
+            }
+            v = first;
+          } else {
+            v = queue.pop(i);
+          }
+          if (v <= 0 || v > static_cast<int>(seen.size()) || seen[v - 1].fetch_add(1, std::memory_order_relaxed) > 0) {
+            std::clog << "Invalid or duplicate value " << v << std::endl;
+            success = false;
+            return;
+          }
+          push(initial_size + static_cast<int>(i) * ops_per_thread + j + 1, i);
+        }
+      });
+    }
+  }
+  std::clog << "Finished " << name << " stress Test\n";
+  return success;
+}
+
+int main() {
+  bool success = tree_stress_test("inline", TreeOptions{.cooperative_rebuild_min_size = 64})
+               & tree_stress_test("incremental", TreeOptions{.cooperative_rebuild_min_size = 64, .rebuild_mode = RebuildMode::kIncremental, .incremental_chunk_size = 16})
+               & tree_stress_test("background", TreeOptions{.cooperative_rebuild_min_size = 64, .rebuild_mode = RebuildMode::kBackground})
+               & tree_stress_test("leaf block veb", TreeOptions{.leaf_block_size = 31, .veb_layout = true})
+               & queue_stress_test<WaitFreeQueue<int>>("WaitFreeQueue")
+               & queue_stress_test<TupleQueue<int, int>>("TupleQueue");
+  if (invariant_tsc_supported())
+    success &= tree_stress_test("tsc", TreeOptions{.timestamp_source = TimestampSource::kTsc});
+  return !success;
+}
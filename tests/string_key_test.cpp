@@ -0,0 +1,112 @@
+#include "implementation/concurrent_tree.hpp"
+#include "implementation/string_key.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+
+std::vector<std::string> make_paths(std::size_t num, std::uint32_t seed) {
+    const std::vector<std::string> segments = {"api", "v1", "v2", "users", "items", "a", "static", "img", "search", "x"};
+    std::mt19937 g(seed);
+    std::uniform_int_distribution<std::size_t> seg_dist(0, segments.size() - 1);
+    std::uniform_int_distribution<int> len_dist(1, 5);
+    std::vector<std::string> paths;
+    paths.reserve(num);
+    for (std::size_t i = 0; i < num; ++i) {
+        std::string p;
+        int len = len_dist(g);
+        for (int j = 0; j < len; ++j) {
+            p += "/" + segments[seg_dist(g)];
+        }
+        p += "/" + std::to_string(i);
+        paths.push_back(p);
+    }
+    return paths;
+}
+
+bool ordering_test() {
+    constexpr auto num_elements = 20000;
+    StringArena arena;
+    std::vector<std::string> paths = make_paths(num_elements, 7);
+    paths.push_back("/a");
+    paths.push_back("/abcdefg");
+    paths.push_back("/abcdefgh");
+    paths.push_back("/abcdefg/");
+
+    std::mt19937 g(42);
+    std::uniform_int_distribution<std::size_t> dist(0, paths.size() - 1);
+    for (int i = 0; i < 200000; ++i) {
+        const std::string& a = paths[dist(g)];
+        const std::string& b = paths[dist(g)];
+        StringKey ka = arena.make(a);
+        StringKey kb = arena.make(b);
+        if ((ka < kb) != (a < b) || (ka == kb) != (a == b) || (ka > kb) != (a > b)) {
+            std::clog << "Wrong comparison " << a << " " << b << std::endl;
+            return false;
+        }
+        if (ka.to_string() != a) {
+            std::clog << "Wrong roundtrip " << a << " " << ka.to_string() << std::endl;
+            return false;
+        }
+    }
+    std::clog << "Ordering test successful\n";
+    return true;
+}
+
+bool tree_test() {
+    const auto num_threads = std::thread::hardware_concurrency();
+    constexpr auto num_elements = 16000;
+
+    std::vector<std::string> paths = make_paths(num_elements, 3);
+    std::vector<StringArena> arenas(num_threads);
+    StringArena main_arena;
+
+    std::vector<StringKey> initial;
+    for (std::size_t i = 0; i < num_elements / 2; ++i) {
+        initial.push_back(main_arena.make(paths[i]));
+    }
+    ConcurrentTree<StringKey> tree(initial, num_threads);
+
+    std::clog << "Using " << num_threads << " threads" << std::endl;
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(num_threads);
+        const auto elem_per_thread = (num_elements / 2) / num_threads;
+        for (auto i = 0u; i < num_threads; ++i) {
+            threads.emplace_back([&, i] {
+                for (unsigned int j = 0; j < elem_per_thread; ++j) {
+                    std::size_t index = num_elements / 2 + i * elem_per_thread + j;
+                    if (!tree.insert(arenas[i].make(paths[index]), i))
+                        std::clog << "Failed to insert " << paths[index] << std::endl;
+                }
+            });
+        }
+    }
+
+    bool success = true;
+    int missing = 0;
+    const auto inserted = num_elements / 2 + ((num_elements / 2) / num_threads) * num_threads;
+    for (std::size_t i = 0; i < inserted; ++i) {
+        //use a key from a different arena, so the comparison can not be decided by the suffix pointer
+        if (!tree.lookup(main_arena.make(paths[i]), 0)) {
+            std::clog << "Failed to lookup " << paths[i] << std::endl;
+            success = false;
+            ++missing;
+        }
+    }
+    if (tree.lookup(main_arena.make("/not/part/of/the/tree"), 0)) {
+        std::clog << "Found value that is not part of the tree" << std::endl;
+        success = false;
+    }
+    std::clog << missing << " values missing\n";
+    std::clog << "String tree test ended\n";
+    return success;
+}
+
+int main() {
+    return !ordering_test() | !tree_test();
+}
@@ -1,4 +1,5 @@
 #include "implementation/concurrent_tree.hpp"
+#include "implementation/sharded_tree.hpp"
 
 #include <atomic>
 #include <iostream>
@@ -6,6 +7,9 @@
 #include <vector>
 #include <numeric>
 #include <random>
+#include <set>
+#include <filesystem>
+#include <string>
 
 bool insert_test() {
   const auto num_threads = std::thread::hardware_concurrency();
@@ -221,6 +225,522 @@ bool range_test() {
   return success;
 }
 
+bool bulk_build_test() {
+  constexpr auto num_elements = 200000;
+
+  std::vector<int> sorted(num_elements);
+  std::iota(sorted.begin(), sorted.end(), 1);
+  std::vector<int> shuffled = sorted;
+  std::mt19937 g(42);
+  std::shuffle(shuffled.begin(), shuffled.end(), g);
+
+  ConcurrentTree<int> tree_sorted(std::span<const int>(sorted), 1, TreeOptions{.build_threads = 4});
+  ConcurrentTree<int> tree_shuffled(shuffled, 1, TreeOptions{.build_threads = 4});
+  ConcurrentTree<int> tree_empty(std::vector<int>{}, 1);
+
+  bool success = true;
+  for (int i = 1; i <= num_elements; i += 97) {
+    if (!tree_sorted.lookup(i, 0) || !tree_shuffled.lookup(i, 0)) {
+      std::clog << "Failed to lookup " << i << std::endl;
+      success = false;
+    }
+  }
+  if (tree_sorted.range_count(1000, 2999, 0) != 2000 || tree_shuffled.range_count(1000, 2999, 0) != 2000) {
+    std::clog << "Wrong range count after bulk build" << std::endl;
+    success = false;
+  }
+  if (tree_empty.lookup(1, 0)) {
+    std::clog << "Found value in empty tree" << std::endl;
+    success = false;
+  }
+  std::clog << "Finished bulk build Test\n";
+  return success;
+}
+
+bool snapshot_test() {
+  constexpr auto num_elements = 50000;
+  const std::string path = (std::filesystem::temp_directory_path() / "wait_free_tree_snapshot_test.bin").string();
+
+  std::vector<int> data(num_elements);
+  std::iota(data.begin(), data.end(), 1);
+  ConcurrentTree<int> tree(data, 1);
+  for (int i = 2; i <= num_elements; i += 2) {
+    tree.remove(i, 0);
+  }
+  tree.insert(num_elements + 1, 0);
+  tree.save(path);
+
+  bool success = true;
+  auto loaded = ConcurrentTree<int>::load(path, 1);
+  for (int i = 1; i <= num_elements + 1; ++i) {
+    if (loaded->lookup(i, 0) != (i % 2 == 1)) {
+      std::clog << "Wrong lookup after load " << i << std::endl;
+      success = false;
+    }
+  }
+  if (loaded->range_count(1, num_elements + 1, 0) != num_elements / 2 + 1) {
+    std::clog << "Wrong range count after load" << std::endl;
+    success = false;
+  }
+
+  try {
+    auto wrong_type = ConcurrentTree<long>::load(path, 1);
+    std::clog << "Loaded snapshot with wrong key type" << std::endl;
+    success = false;
+  } catch (const std::runtime_error&) {
+  }
+  std::filesystem::remove(path);
+
+  std::clog << "Finished snapshot Test\n";
+  return success;
+}
+
+bool split_merge_test() {
+  constexpr auto num_elements = 100000;
+  constexpr auto split = 31337;
+
+  std::vector<int> data(num_elements);
+  std::iota(data.begin(), data.end(), 1);
+  ConcurrentTree<int> tree(data, 1);
+
+  bool success = true;
+  auto check = [&](ConcurrentTree<int>& t, int lower, int upper, bool removed) {
+    for (int i = 1; i <= num_elements; i += 7) {
+      bool should = i >= lower && i <= upper && (!removed || i % 10 != 0);
+      if (t.lookup(i, 0) != should) {
+        std::clog << "Wrong lookup after split/merge " << i << std::endl;
+        success = false;
+      }
+    }
+    //range counts are only exact without removals
+    if (!removed && t.range_count(1, num_elements, 0) != static_cast<std::uint32_t>(std::max(0, upper - lower + 1))) {
+      std::clog << "Wrong range count after split/merge " << lower << " " << upper << std::endl;
+      success = false;
+    }
+  };
+
+  auto upper = tree.split_at(split);
+  check(tree, 1, split - 1, false);
+  check(*upper, split, num_elements, false);
+
+  try {
+    tree.merge(tree);
+    std::clog << "Merged overlapping trees" << std::endl;
+    success = false;
+  } catch (const std::invalid_argument&) {
+  }
+
+  upper->merge(tree);
+  check(*upper, 1, num_elements, false);
+  check(tree, 1, 0, false);
+
+  //keep using the trees after splitting them again
+  auto upper2 = upper->split_at(split);
+  for (int i = 10; i <= num_elements; i += 10) {
+    if (i < split)
+      upper->remove(i, 0);
+    else
+      upper2->remove(i, 0);
+  }
+  upper2->merge(*upper);
+  check(*upper2, 1, num_elements, true);
+
+  std::clog << "Finished split/merge Test\n";
+  return success;
+}
+
+bool cooperative_rebuild_test(RebuildMode mode) {
+  constexpr auto num_threads = 4u;
+  constexpr auto num_elements = 40000;
+
+  std::vector<int> data(num_elements);
+  std::iota(data.begin(), data.end(), 1);
+  //rebuild nearly every subtree cooperatively, so the chunks are small and shared by many threads
+  ConcurrentTree<int> tree(data, num_threads, TreeOptions{.cooperative_rebuild_min_size = 64, .rebuild_mode = mode, .incremental_chunk_size = 16});
+
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (auto i = 0u; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = static_cast<int>(i) * 2 + 2; j <= num_elements; j += 2 * num_threads) {
+          tree.remove(j, i);
+          if (!tree.insert(num_elements + j, i))
+            std::clog << "Failed to insert " << num_elements + j << std::endl;
+        }
+      });
+    }
+  }
+
+  bool success = true;
+  for (int i = 1; i <= num_elements; ++i) {
+    if (tree.lookup(i, 0) != (i % 2 == 1) || (i % 2 == 0 && !tree.lookup(num_elements + i, 0))) {
+      std::clog << "Wrong lookup result for " << i << std::endl;
+      success = false;
+    }
+  }
+  std::clog << "Finished " << (mode == RebuildMode::kBackground ? "background" : mode == RebuildMode::kIncremental ? "incremental" : "cooperative") << " rebuild Test\n";
+  return success;
+}
+
+template <class Policy>
+bool rebuild_policy_test(const std::string& name) {
+  constexpr auto num_threads = 4u;
+  constexpr auto num_elements = 20000;
+
+  std::vector<int> data(num_elements);
+  std::iota(data.begin(), data.end(), 1);
+  ConcurrentTree<int, true, Policy> tree(data, num_threads);
+
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (auto i = 0u; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = static_cast<int>(i) * 2 + 2; j <= num_elements; j += 2 * num_threads) {
+          tree.remove(j, i);
+          //mostly reads, so the adaptive policy rebuilds more eagerly
+          for (int k = 0; k < 4; ++k) {
+            if (!tree.lookup(j - 1, i))
+              std::clog << "Failed to lookup " << j - 1 << std::endl;
+          }
+          if (!tree.insert(num_elements + j, i))
+            std::clog << "Failed to insert " << num_elements + j << std::endl;
+        }
+      });
+    }
+  }
+
+  bool success = true;
+  for (int i = 1; i <= num_elements; ++i) {
+    if (tree.lookup(i, 0) != (i % 2 == 1) || (i % 2 == 0 && !tree.lookup(num_elements + i, 0))) {
+      std::clog << "Wrong lookup result for " << i << std::endl;
+      success = false;
+    }
+  }
+  std::clog << "Finished " << name << " rebuild policy Test\n";
+  return success;
+}
+
+bool layout_test(const std::string& name, const TreeOptions& options) {
+  constexpr auto num_threads = 4u;
+  constexpr auto num_elements = 20000;
+
+  //multiples of 4, so the values inserted in between go below the fat leaves
+  std::vector<int> data(num_elements);
+  for (int i = 0; i < num_elements; ++i) {
+    data[i] = 4 * (i + 1);
+  }
+  ConcurrentTree<int> tree(data, num_threads, options);
+
+  auto run_threads = [&](auto&& work) {
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (auto i = 0u; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = static_cast<int>(i) + 1; j <= num_elements; j += num_threads) {
+          work(j, i);
+        }
+      });
+    }
+  };
+
+  run_threads([&](int j, std::size_t tid) {
+    if (!tree.insert(4 * j + 2, tid))
+      std::clog << "Failed to insert " << 4 * j + 2 << std::endl;
+    if (!tree.lookup(4 * j, tid) || !tree.lookup(4 * j + 2, tid))
+      std::clog << "Failed to lookup " << 4 * j << std::endl;
+  });
+
+  bool success = true;
+  //range counts are only exact without removals
+  for (int l = 1; l < 4 * num_elements; l += 997) {
+    int r = l + 3 * l % 5000;
+    //the even values in [max(l, 4), min(r, 4 * num_elements + 2)]
+    std::uint32_t expected = static_cast<std::uint32_t>(std::min(r, 4 * num_elements + 2) / 2 - (std::max(l, 4) + 1) / 2 + 1);
+    if (tree.range_count(l, r, 0) != expected) {
+      std::clog << "Wrong range count " << l << " " << r << std::endl;
+      success = false;
+    }
+  }
+
+  run_threads([&](int j, std::size_t tid) {
+    tree.remove(4 * j, tid);
+    if (tree.lookup(4 * j, tid))
+      std::clog << "Wrong lookup result for " << 4 * j << std::endl;
+    if (j % 2 == 0 && !tree.insert(4 * j, tid))
+      std::clog << "Failed to insert " << 4 * j << std::endl;
+  });
+
+  for (int i = 1; i <= 4 * num_elements + 3; ++i) {
+    //the inserted values and the reinserted multiples of 8
+    const bool expected = (i % 4 == 2 && i > 2) || (i % 8 == 0 && i > 0);
+    if (tree.lookup(i, 0) != expected) {
+      std::clog << "Wrong lookup result for " << i << std::endl;
+      success = false;
+    }
+  }
+
+  if (options.leaf_block_size > 0) {
+    try {
+      ConcurrentTree<int> incremental(num_threads, TreeOptions{.rebuild_mode = RebuildMode::kIncremental, .leaf_block_size = options.leaf_block_size});
+      std::clog << "Created leaf blocks with an incremental rebuild" << std::endl;
+      success = false;
+    } catch (const std::invalid_argument&) {
+    }
+  }
+  std::clog << "Finished " << name << " layout Test\n";
+  return success;
+}
+
+bool sharded_test() {
+  constexpr auto num_threads = 4u;
+  constexpr auto num_elements = 20000;
+
+  std::vector<int> data(num_elements);
+  std::iota(data.begin(), data.end(), 1);
+  std::shuffle(data.begin(), data.end(), std::default_random_engine(1));
+  ShardedConcurrentTree<int> tree(data, 8, num_threads);
+
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (auto i = 0u; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = static_cast<int>(i) + 1; j <= num_elements; j += num_threads) {
+          if (!tree.insert(num_elements + j, i))
+            std::clog << "Failed to insert " << num_elements + j << std::endl;
+          if (!tree.lookup(j, i))
+            std::clog << "Failed to lookup " << j << std::endl;
+        }
+      });
+    }
+  }
+
+  bool success = tree.num_shards() == 8;
+  for (int i = 1; i <= 2 * num_elements + 1; ++i) {
+    if (tree.lookup(i, 0) != (i <= 2 * num_elements)) {
+      std::clog << "Wrong lookup result for " << i << std::endl;
+      success = false;
+    }
+  }
+  //range counts are only exact without removals
+  for (int l = 1; l < 2 * num_elements; l += 997) {
+    int r = l + 3 * l % 9000;
+    if (tree.range_count(l, r, 0) != static_cast<std::uint32_t>(std::min(r, 2 * num_elements) - l + 1)) {
+      std::clog << "Wrong range count " << l << " " << r << std::endl;
+      success = false;
+    }
+  }
+  try {
+    ShardedConcurrentTree<int> unordered(std::vector<int>{5, 3}, 1);
+    std::clog << "Created shards with unordered boundaries" << std::endl;
+    success = false;
+  } catch (const std::invalid_argument&) {
+  }
+  std::clog << "Finished sharded Test\n";
+  return success;
+}
+
+bool elimination_test() {
+  constexpr auto num_threads = 4u;
+  constexpr auto num_elements = 1000;
+  constexpr auto num_hot_keys = 4;
+  constexpr auto iterations = 2000;
+
+  std::vector<int> data(num_elements);
+  std::iota(data.begin(), data.end(), 1);
+  ConcurrentTree<int> tree(data, num_threads);
+  std::atomic<int> failed = 0;
+
+  //all threads work on the same few values, so their operations often get neighbouring timestamps
+  auto run_threads = [&](auto&& work) {
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (auto i = 0u; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < iterations; ++j) {
+          work(num_elements + 1 + j % num_hot_keys, i);
+        }
+      });
+    }
+  };
+
+  //no removes, so a value is found after it was inserted
+  run_threads([&](int value, std::size_t tid) {
+    tree.insert(value, tid);
+    if (!tree.lookup(value, tid) || !tree.lookup(value, tid))
+      failed.fetch_add(1);
+  });
+  //no inserts, so a value is not found after it was removed
+  run_threads([&](int value, std::size_t tid) {
+    tree.remove(value, tid);
+    if (tree.lookup(value, tid))
+      failed.fetch_add(1);
+  });
+  //every remove is followed by an insert of the same thread, so all values are part of the tree at the end
+  run_threads([&](int value, std::size_t tid) {
+    tree.remove(value, tid);
+    tree.insert(value, tid);
+  });
+
+  bool success = failed.load() == 0;
+  for (int i = 1; i <= num_elements + num_hot_keys + 1; ++i) {
+    if (tree.lookup(i, 0) != (i <= num_elements + num_hot_keys)) {
+      std::clog << "Wrong lookup result for " << i << std::endl;
+      success = false;
+    }
+  }
+  std::clog << failed.load() << " wrong lookups of hot values\n";
+  std::clog << "Finished elimination Test\n";
+  return success;
+}
+
+bool fixed_threads_test() {
+  constexpr auto num_threads = 4u;
+  constexpr auto num_elements = 20000;
+
+  std::vector<int> data(num_elements);
+  for (int i = 0; i < num_elements; ++i) {
+    data[i] = 2 * (i + 1);
+  }
+  //room for more threads than used, the unused slots have to be skipped by the scans
+  ConcurrentTree<int, true, DefaultRebuildPolicy, 8> tree(data, num_threads);
+
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(num_threads);
+    for (auto i = 0u; i < num_threads; ++i) {
+      threads.emplace_back([&, i] {
+        for (int j = static_cast<int>(i) + 1; j <= num_elements; j += num_threads) {
+          if (!tree.insert(2 * j - 1, i))
+            std::clog << "Failed to insert " << 2 * j - 1 << std::endl;
+          if (!tree.lookup(2 * j, i))
+            std::clog << "Failed to lookup " << 2 * j << std::endl;
+          if (tree.range_count(2 * j, 2 * j, i) != 1)
+            std::clog << "Failed range query at " << 2 * j << std::endl;
+        }
+      });
+    }
+  }
+
+  bool success = tree.range_count(1, 2 * num_elements, 0) == static_cast<std::uint32_t>(2 * num_elements);
+  for (int i = 1; i <= 2 * num_elements + 1; ++i) {
+    if (tree.lookup(i, 0) != (i <= 2 * num_elements)) {
+      std::clog << "Wrong lookup result for " << i << std::endl;
+      success = false;
+    }
+  }
+  try {
+    ConcurrentTree<int, true, DefaultRebuildPolicy, 8> too_many(9);
+    std::clog << "Wrong thread count accepted" << std::endl;
+    success = false;
+  } catch (const std::invalid_argument&) {
+  }
+  std::clog << "Finished fixed threads Test\n";
+  return success;
+}
+
+bool uncontended_reads_test(const std::string& name, const TreeOptions& options) {
+  constexpr auto num_elements = 20000;
+
+  std::vector<int> data(num_elements);
+  for (int i = 0; i < num_elements; ++i) {
+    data[i] = 4 * (i + 1);
+  }
+  //a single thread, so every lookup and range count reads the tree directly
+  ConcurrentTree<int> tree(data, 1, options);
+  std::set<int> values(data.begin(), data.end());
+
+  std::default_random_engine rng(7);
+  std::uniform_int_distribution<> dist(1, 4 * num_elements + 4);
+  bool success = true;
+  auto check_lookup = [&](int value) {
+    if (tree.lookup(value, 0) != values.contains(value)) {
+      std::clog << "Wrong lookup result for " << value << std::endl;
+      success = false;
+    }
+  };
+
+  //range counts are only exact without removals
+  for (int i = 0; i < 30000; ++i) {
+    const int value = dist(rng);
+    if (i % 2 == 0 && !values.contains(value)) {
+      tree.insert(value, 0);
+      values.insert(value);
+    }
+    check_lookup(value);
+    const int upper = value + i % 2000;
+    if (tree.range_count(value, upper, 0) != static_cast<std::uint32_t>(std::distance(values.lower_bound(value), values.upper_bound(upper)))) {
+      std::clog << "Wrong range count " << value << " " << upper << std::endl;
+      success = false;
+    }
+  }
+  for (int i = 0; i < 30000; ++i) {
+    const int value = dist(rng);
+    if (i % 2 == 0 && values.contains(value)) {
+      tree.remove(value, 0);
+      values.erase(value);
+    }
+    check_lookup(value);
+  }
+  std::clog << "Finished " << name << " uncontended reads Test\n";
+  return success;
+}
+
+bool tsc_timestamps_test() {
+  constexpr auto num_threads = 4u;
+  constexpr auto num_elements = 20000;
+
+  if (!invariant_tsc_supported()) {
+    std::clog << "Skipped tsc timestamps Test, no invariant TSC\n";
+    return true;
+  }
+  std::vector<int> data(num_elements);
+  for (int i = 0; i < num_elements; ++i) {
+    data[i] = 2 * (i + 1);
+  }
+  ConcurrentTree<int> tree(data, num_threads, TreeOptions{.timestamp_source = TimestampSource::kTsc});
+  std::atomic<int> failed = 0;
+
+  //every thread checks the results of its own operations, which are only right if the timestamps order them
+  std::vector<std::jthread> threads;
+  threads.reserve(num_threads);
+  for (auto i = 0u; i < num_threads; ++i) {
+    threads.emplace_back([&, i] {
+      for (int j = static_cast<int>(i); j < num_elements; j += num_threads) {
+        const int value = 2 * j + 1;
+        if (!tree.insert(value, i) || !tree.lookup(value, i))
+          failed.fetch_add(1);
+        tree.remove(2 * (j + 1), i);
+        if (tree.lookup(2 * (j + 1), i))
+          failed.fetch_add(1);
+      }
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+
+  bool success = failed.load() == 0;
+  for (int i = 1; i <= 2 * num_elements + 1; ++i) {
+    if (tree.lookup(i, 0) != (i % 2 == 1 && i < 2 * num_elements)) {
+      std::clog << "Wrong lookup result for " << i << std::endl;
+      success = false;
+    }
+  }
+  try {
+    ConcurrentTree<int> counter(num_threads);
+    tree.merge(counter);
+    std::clog << "Merged trees with different timestamp sources" << std::endl;
+    success = false;
+  } catch (const std::invalid_argument&) {
+  }
+  std::clog << failed.load() << " wrong results\n";
+  std::clog << "Finished tsc timestamps Test\n";
+  return success;
+}
+
 int main() {
-  return !insert_test() | !remove_test() | !range_test();
+  return !insert_test() | !remove_test() | !range_test() | !bulk_build_test() | !snapshot_test() | !split_merge_test() | !cooperative_rebuild_test(RebuildMode::kInline) | !cooperative_rebuild_test(RebuildMode::kIncremental) | !cooperative_rebuild_test(RebuildMode::kBackground) | !rebuild_policy_test<DepthBoundRebuildPolicy<>>("depth bound") | !rebuild_policy_test<AdaptiveRebuildPolicy>("adaptive") | !layout_test("leaf block", TreeOptions{.leaf_block_size = 31}) | !layout_test("veb", TreeOptions{.veb_layout = true}) | !layout_test("leaf block veb", TreeOptions{.leaf_block_size = 31, .veb_layout = true}) | !sharded_test() | !elimination_test() | !fixed_threads_test() | !uncontended_reads_test("plain", TreeOptions{}) | !uncontended_reads_test("leaf block", TreeOptions{.leaf_block_size = 31}) | !tsc_timestamps_test();
 }